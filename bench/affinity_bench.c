@@ -0,0 +1,129 @@
+#include "load_balancer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+// Cache-sensitive workload: every key owns a working set sized to stay in a
+// core's L2, and each task walks it several times. Tasks that land where their
+// key ran last find the data warm.
+
+typedef struct {
+    uint64_t* data;
+    size_t words;
+} KeyState;
+
+static volatile uint64_t sink;
+static int completed = 0;
+
+static void walk_working_set(void* arg) {
+    KeyState* state = (KeyState*)arg;
+    uint64_t sum = 0;
+
+    for (int pass = 0; pass < 8; pass++) {
+        for (size_t i = 0; i < state->words; i += 8) {
+            sum += state->data[i];
+            state->data[i] = sum;
+        }
+    }
+
+    sink += sum;
+    __atomic_fetch_add(&completed, 1, __ATOMIC_RELEASE);
+}
+
+static double elapsed_sec(const struct timespec* start, const struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void run(int num_cpus, int num_tasks, KeyState* keys, int num_keys, int use_keys) {
+    LoadBalancerConfig* config = init_default_config();
+    config->num_cpus = num_cpus;
+    config->max_tasks = num_tasks;
+    config->max_queue_capacity = num_tasks;
+    config->enable_detailed_logging = 0;
+    // Every task must go through placement: a walk is short enough to be
+    // coalesced or inlined, which would bypass the affinity lookup
+    config->inline_queue_depth = 0;
+    config->coalesce_batch_size = 1;
+    free(config->log_file_path);
+    config->log_file_path = strdup("./affinity_bench.log");
+
+    LoadBalancer* lb = init_load_balancer(config);
+    if (!lb) {
+        fprintf(stderr, "Failed to initialize load balancer\n");
+        exit(1);
+    }
+    start_load_balancer(lb);
+
+    __atomic_store_n(&completed, 0, __ATOMIC_RELEASE);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < num_tasks; i++) {
+        int key = i % num_keys;
+        TaskOptions options = {0};
+        options.affinity_key = use_keys ? (uint64_t)key + 1 : 0;
+        submit_task_ex(lb, walk_working_set, &keys[key], PRIORITY_MEDIUM, &options);
+    }
+    while (__atomic_load_n(&completed, __ATOMIC_ACQUIRE) < num_tasks) {
+        usleep(1000);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stop_load_balancer(lb);
+
+    LoadBalancerStats stats;
+    get_load_balancer_stats(lb, &stats);
+    double seconds = elapsed_sec(&start, &end);
+    uint64_t keyed = stats.affinity_hits + stats.affinity_sibling_hits + stats.affinity_misses;
+
+    printf("%-12s %10.3f s %12.1f tasks/s", use_keys ? "affinity" : "load-only",
+           seconds, num_tasks / seconds);
+    if (keyed > 0) {
+        printf("   hit %.1f%%  sibling %.1f%%  miss %.1f%%",
+               100.0 * stats.affinity_hits / keyed,
+               100.0 * stats.affinity_sibling_hits / keyed,
+               100.0 * stats.affinity_misses / keyed);
+    }
+    printf("\n%12s dispatched %lu, coalesced %lu, inlined %lu, failed %lu\n", "",
+           stats.tasks_dispatched, stats.tasks_coalesced, stats.tasks_inlined, stats.tasks_failed);
+
+    cleanup_load_balancer(lb);
+    free_config(config);
+}
+
+int main(int argc, char** argv) {
+    int online = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int num_cpus = argc > 1 ? atoi(argv[1]) : online;
+    int num_tasks = argc > 2 ? atoi(argv[2]) : 4000;
+    int working_set_kb = argc > 3 ? atoi(argv[3]) : 256;
+
+    if (num_cpus < 1 || num_tasks < 1 || working_set_kb < 1) {
+        fprintf(stderr, "Usage: %s [num_cpus] [num_tasks] [working_set_kb]\n", argv[0]);
+        return 1;
+    }
+    // Tasks pinned to CPUs that don't exist fail, which would skew every figure
+    if (online > 0 && num_cpus > online) {
+        fprintf(stderr, "Only %d CPUs online; using %d\n", online, online);
+        num_cpus = online;
+    }
+    int num_keys = num_cpus * 2;
+
+    KeyState* keys = calloc(num_keys, sizeof(KeyState));
+    for (int k = 0; k < num_keys; k++) {
+        keys[k].words = (size_t)working_set_kb * 1024 / sizeof(uint64_t);
+        keys[k].data = calloc(keys[k].words, sizeof(uint64_t));
+    }
+
+    printf("%d CPUs, %d tasks, %d keys x %d KB working set\n",
+           num_cpus, num_tasks, num_keys, working_set_kb);
+    run(num_cpus, num_tasks, keys, num_keys, 0);
+    run(num_cpus, num_tasks, keys, num_keys, 1);
+
+    for (int k = 0; k < num_keys; k++) {
+        free(keys[k].data);
+    }
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "load_balancer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+
+// Light, bursty workload of the kind packing is meant for: short compute tasks
+// submitted with gaps, so total load stays well below the machine's capacity.
+// Each task records the CPU it ran on and its submit-to-finish latency.
+
+typedef struct {
+    struct timespec submitted;
+    double latency_ms;
+    int cpu;
+    int spin_us;
+} TaskRecord;
+
+static volatile uint64_t sink;
+static int completed = 0;
+
+static double elapsed_ms(const struct timespec* start, const struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void spin_task(void* arg) {
+    TaskRecord* record = (TaskRecord*)arg;
+    struct timespec start, now;
+    uint64_t sum = 0;
+
+    record->cpu = sched_getcpu();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        for (int i = 0; i < 1000; i++) sum += i;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (elapsed_ms(&start, &now) * 1000 < record->spin_us);
+
+    sink += sum;
+    record->latency_ms = elapsed_ms(&record->submitted, &now);
+    __atomic_fetch_add(&completed, 1, __ATOMIC_RELEASE);
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void run(int num_cpus, int num_tasks, int spin_us, int gap_us, PlacementMode mode) {
+    LoadBalancerConfig* config = init_default_config();
+    config->num_cpus = num_cpus;
+    config->max_tasks = num_tasks;
+    config->max_queue_capacity = num_tasks;
+    config->enable_detailed_logging = 0;
+    config->placement_mode = mode;
+    // Compare placement only: coalesced or inlined tasks would skip it
+    config->inline_queue_depth = 0;
+    config->coalesce_batch_size = 1;
+    free(config->log_file_path);
+    config->log_file_path = strdup("./packing_bench.log");
+
+    LoadBalancer* lb = init_load_balancer(config);
+    if (!lb) {
+        fprintf(stderr, "Failed to initialize load balancer\n");
+        exit(1);
+    }
+    start_load_balancer(lb);
+
+    TaskRecord* records = calloc(num_tasks, sizeof(TaskRecord));
+    __atomic_store_n(&completed, 0, __ATOMIC_RELEASE);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < num_tasks; i++) {
+        records[i].spin_us = spin_us;
+        records[i].cpu = -1;
+        clock_gettime(CLOCK_MONOTONIC, &records[i].submitted);
+        submit_task(lb, spin_task, &records[i], PRIORITY_MEDIUM);
+        if (gap_us > 0) usleep(gap_us);
+    }
+    while (__atomic_load_n(&completed, __ATOMIC_ACQUIRE) < num_tasks) {
+        usleep(1000);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stop_load_balancer(lb);
+
+    int* touched = calloc(CPU_SETSIZE, sizeof(int));
+    double* latencies = malloc(sizeof(double) * num_tasks);
+    int cores = 0;
+    double total = 0.0;
+    for (int i = 0; i < num_tasks; i++) {
+        int cpu = records[i].cpu;
+        if (cpu >= 0 && cpu < CPU_SETSIZE && touched[cpu]++ == 0) cores++;
+        latencies[i] = records[i].latency_ms;
+        total += latencies[i];
+    }
+    qsort(latencies, num_tasks, sizeof(double), compare_double);
+
+    printf("%-8s %6d cores %10.1f ms makespan   latency avg %.3f ms  p50 %.3f ms  p99 %.3f ms\n",
+           mode == PLACEMENT_PACK ? "pack" : "spread", cores, elapsed_ms(&start, &end),
+           total / num_tasks, latencies[num_tasks / 2], latencies[num_tasks * 99 / 100]);
+
+    free(touched);
+    free(latencies);
+    free(records);
+    cleanup_load_balancer(lb);
+    free_config(config);
+}
+
+int main(int argc, char** argv) {
+    int online = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int num_cpus = argc > 1 ? atoi(argv[1]) : online;
+    int num_tasks = argc > 2 ? atoi(argv[2]) : 400;
+    int spin_us = argc > 3 ? atoi(argv[3]) : 200;
+    int gap_us = argc > 4 ? atoi(argv[4]) : 1000;
+
+    if (num_cpus < 1 || num_tasks < 1 || spin_us < 0 || gap_us < 0) {
+        fprintf(stderr, "Usage: %s [num_cpus] [num_tasks] [task_us] [gap_us]\n", argv[0]);
+        return 1;
+    }
+    if (online > 0 && num_cpus > online) {
+        fprintf(stderr, "Only %d CPUs online; using %d\n", online, online);
+        num_cpus = online;
+    }
+
+    printf("%d CPUs, %d tasks of %d us, submitted every %d us\n",
+           num_cpus, num_tasks, spin_us, gap_us);
+    run(num_cpus, num_tasks, spin_us, gap_us, PLACEMENT_SPREAD);
+    run(num_cpus, num_tasks, spin_us, gap_us, PLACEMENT_PACK);
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef AFFINITY_TABLE_H
+#define AFFINITY_TABLE_H
+
+#include <stdint.h>
+
+// Bounded, lock-free map from affinity key to the CPU that last ran it.
+// Direct-mapped: each slot packs a 48-bit key tag with the CPU id, and a
+// colliding key simply overwrites the slot, like a hardware cache line.
+typedef struct {
+    uint64_t* slots;
+    uint64_t mask;
+} AffinityTable;
+
+AffinityTable* cpub_init_affinity_table(int capacity);
+int cpub_affinity_lookup(AffinityTable* table, uint64_t key);
+void cpub_affinity_update(AffinityTable* table, uint64_t key, int cpu_id);
+void cpub_cleanup_affinity_table(AffinityTable* table);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef BALANCER_CLIENT_H
+#define BALANCER_CLIENT_H
+
+#include "cpubalancer_export.h"
+#include "shm_ring.h"
+#include <stddef.h>
+
+// Handle on a running balancer's work ring. Safe to share between threads of
+// the client process; several processes may be connected at once.
+typedef struct {
+    ShmRing* ring;
+    uint32_t capacity;            // validated at connect, not reread from the mapping
+    size_t mapped_size;
+} BalancerClient;
+
+CPUBALANCER_API BalancerClient* balancer_client_connect(const char* name);
+CPUBALANCER_API int balancer_client_submit(BalancerClient* client, const WorkDescriptor* work, int timeout_ms);
+CPUBALANCER_API void balancer_client_disconnect(BalancerClient* client);
+
+#endif
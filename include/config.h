@@ -1,11 +1,37 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include "cpubalancer_export.h"
 #include <stdint.h>
 
+typedef enum {
+    QUEUE_POLICY_FIFO,
+    QUEUE_POLICY_EDF      // earliest deadline first
+} QueuePolicy;
+
+typedef enum {
+    DEADLINE_ADMISSION_FLAG,    // accept tasks predicted to miss and dispatch them first
+    DEADLINE_ADMISSION_REJECT   // refuse tasks predicted to miss
+} DeadlineAdmission;
+
+typedef enum {
+    OVERLOAD_BLOCK,          // wait for room in the queue
+    OVERLOAD_REJECT,         // fail the submission immediately
+    OVERLOAD_SHED_LOWEST     // evict a queued lower-priority task, else reject
+} OverloadPolicy;
+
+typedef enum {
+    PLACEMENT_SPREAD,        // least loaded CPU
+    PLACEMENT_PACK,          // fill CPUs in order up to pack_target_utilization
+    PLACEMENT_AUTO           // pack below low_load_threshold, spread above high_load_threshold
+} PlacementMode;
+
 typedef struct {
     int max_tasks;
     int monitoring_interval_ms;
+    int max_monitoring_interval_ms;    // ceiling the interval backs off to while load is stable
+    int min_sample_gap_ms;             // floor between samples, including requested ones
+    double stable_load_delta;          // per-CPU usage change (%) still considered stable
     double high_load_threshold;
     double low_load_threshold;
     int load_history_size;
@@ -14,16 +40,47 @@ typedef struct {
     char* log_file_path;
     int rebalance_threshold;
     int min_task_runtime_ms;
+    int coalesce_batch_size;
+    int inline_queue_depth;
+    QueuePolicy queue_policy;
+    DeadlineAdmission deadline_admission;
+    OverloadPolicy overload_policy;
+    int max_queue_capacity;
+    int queue_high_watermark;
+    int queue_low_watermark;
+    int timer_tick_ms;
+    int shutdown_grace_ms;
+    uint64_t critical_lane_cpu_mask;   // cores reserved for PRIORITY_CRITICAL, 0 disables the lane
+    int critical_ring_size;
+    int critical_spin_count;           // busy-poll iterations before a lane worker backs off
+    int affinity_table_size;
+    double affinity_load_margin;       // effective load a key's warm CPU may exceed the best CPU by
+    int enable_fair_share;
+    int default_group_weight;
+    int max_running_tasks;             // dispatched tasks allowed at once; 0 is one per CPU
+                                       // with fair share, unlimited without
+    PlacementMode placement_mode;
+    double pack_target_utilization;    // effective load (%) a CPU is filled to before the next opens
+    char* shm_ring_name;               // POSIX shm object cpu_balancerd accepts work on
+    int shm_ring_size;
+    char* proc_root;                   // where stat and pressure/cpu are read from
+    char* sysfs_root;                  // where CPU topology, cpufreq and thermal data are read from
+    double thermal_limit_c;            // core temperature above which placement derates the core
+    int enable_elastic_cpus;
+    int min_active_cpus;
+    double psi_high_threshold;         // cpu "some avg10" (%) above which a core is yielded
+    double psi_low_threshold;          // cpu "some avg10" (%) below which a core is reclaimed
+    int elastic_hysteresis_samples;    // consecutive samples needed before either change
     int num_cpus;
 } LoadBalancerConfig;
 
 // Initialize with default configuration
-LoadBalancerConfig* init_default_config(void);
+CPUBALANCER_API LoadBalancerConfig* init_default_config(void);
 
 // Load configuration from file
-LoadBalancerConfig* load_config(const char* config_path);
+CPUBALANCER_API LoadBalancerConfig* load_config(const char* config_path);
 
 // Free configuration
-void free_config(LoadBalancerConfig* config);
+CPUBALANCER_API void free_config(LoadBalancerConfig* config);
 
 #endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define CPU_STATS_H
 
 #include <stdint.h>
+#include <stdio.h>
 #include "config.h"
 
 typedef struct {
@@ -17,21 +18,50 @@ typedef struct {
     uint64_t irq_time;
     uint64_t softirq_time;
     uint64_t steal_time;
-    double temperature;
+    double temperature;     // degrees C, 0 if no sensor covers this CPU
+    char* temp_path;        // coretemp input or mapped thermal zone, NULL if none
     double predicted_load;
     int active_tasks;
+    int reserved;           // owned by the critical lane, skipped for normal work
+    int l2_domain;          // lowest CPU id sharing this CPU's L2, -1 if unknown
+    int l3_domain;          // lowest CPU id sharing this CPU's L3, -1 if unknown
+    int parked;             // yielded to other processes, skipped for new work
+    int core_id;            // topology core_id and physical_package_id, -1 if unknown
+    int package_id;
+    int max_freq_khz;       // cpuinfo_max_freq, 0 if cpufreq is unavailable
+    int cur_freq_khz;       // scaling_cur_freq at the last sample
+    double base_capacity;   // relative to the fastest CPU: cpu_capacity or max frequency
+    double capacity;        // base_capacity derated for clock-down and temperature
 } CPUStats;
 
 typedef struct {
     CPUStats* stats;
     int num_cpus;
     LoadBalancerConfig* config;
+    // Elastic CPU set, updated from the monitor thread
+    double cpu_pressure;    // last "some avg10" from pressure/cpu, -1 if unavailable
+    double foreign_share;   // share of the last sample's busy time not used by us, -1 if unknown
+    double host_pressure;   // cpu_pressure less our estimated own part, -1 if unavailable
+    uint64_t own_cpu_ticks; // utime + stime of this process at the last sample
+    int own_sampled;
+    int contended_samples;
+    int idle_samples;
+    int pressure_warned;
+    uint64_t cpus_parked;
+    uint64_t cpus_unparked;
 } CPUMonitor;
 
-CPUMonitor* init_cpu_monitor(LoadBalancerConfig* config);
-void update_cpu_stats(CPUMonitor* monitor);
-double predict_cpu_load(CPUStats* cpu);
-void print_cpu_stats(CPUMonitor* monitor);
-void cleanup_cpu_monitor(CPUMonitor* monitor);
+CPUMonitor* cpub_init_cpu_monitor(LoadBalancerConfig* config);
+void cpub_load_cpu_topology(CPUMonitor* monitor);
+void cpub_update_cpu_stats(CPUMonitor* monitor);
+void cpub_update_cpu_capacity(CPUMonitor* monitor);
+int cpub_read_cpu_pressure(CPUMonitor* monitor, double* some_avg10);
+int cpub_cpu_available(CPUMonitor* monitor, int cpu_id);
+int cpub_count_active_cpus(CPUMonitor* monitor);
+int cpub_update_elastic_cpus(CPUMonitor* monitor);
+double cpub_predict_cpu_load(CPUStats* cpu);
+CPUBALANCER_API void print_cpu_stats(CPUMonitor* monitor, FILE* out);
+void cpub_log_cpu_stats(CPUMonitor* monitor);
+void cpub_cleanup_cpu_monitor(CPUMonitor* monitor);
 
 #endif
\ No newline at end of file
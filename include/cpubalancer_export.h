@@ -0,0 +1,13 @@
+#ifndef CPUBALANCER_EXPORT_H
+#define CPUBALANCER_EXPORT_H
+
+// Marks the public API of libcpubalancer. The library is compiled with hidden
+// visibility, so everything without this stays internal: calls to it bind
+// locally and link-time optimization is free to inline or drop it.
+#if defined(__GNUC__) || defined(__clang__)
+#define CPUBALANCER_API __attribute__((visibility("default")))
+#else
+#define CPUBALANCER_API
+#endif
+
+#endif
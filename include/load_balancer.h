@@ -1,30 +1,127 @@
 #ifndef LOAD_BALANCER_H
 #define LOAD_BALANCER_H
 
+#include "cpubalancer_export.h"
 #include "config.h"
 #include "cpu_stats.h"
 #include "task_queue.h"
+#include "task_profile.h"
+#include "timer_wheel.h"
+#include "task_ring.h"
+#include "affinity_table.h"
 #include <pthread.h>
 #include <sched.h>
+#include <stdint.h>
 
+// Log2 buckets of deadline lateness in milliseconds: [0,1), [1,2), [2,4), ...
+#define LATENESS_BUCKETS 16
+// Log2 buckets of critical-lane submit-to-start latency in microseconds
+#define LATENCY_BUCKETS 16
 
 typedef struct {
+    uint64_t tasks_submitted;
+    uint64_t tasks_dispatched;     // ran on their own thread
+    uint64_t tasks_coalesced;      // ran as part of a batch
+    uint64_t batches_dispatched;
+    uint64_t tasks_inlined;        // ran on the submitting thread
+    uint64_t tasks_failed;         // dequeued but could not be dispatched
+    uint64_t deadline_met;
+    uint64_t deadline_missed;
+    uint64_t deadline_rejected;    // refused at admission
+    uint64_t deadline_flagged;     // admitted although predicted to miss
+    uint64_t lateness_histogram[LATENESS_BUCKETS];
+    uint64_t rejected_by_priority[NUM_PRIORITIES];   // queue full
+    uint64_t shed_by_priority[NUM_PRIORITIES];       // evicted for a higher priority task
+    uint64_t tasks_cancelled;
+    uint64_t tasks_timed_out;
+    uint64_t critical_lane_tasks;
+    uint64_t critical_latency_total_ns;
+    uint64_t critical_latency_max_ns;
+    uint64_t critical_latency_histogram[LATENCY_BUCKETS];
+    uint64_t affinity_hits;          // placed on the key's previous CPU
+    uint64_t affinity_sibling_hits;  // placed on a CPU sharing its L2/L3
+    uint64_t affinity_misses;
+    int cpus_active;                 // CPUs currently accepting normal work
+    uint64_t cpus_parked;            // elastic shrink events
+    uint64_t cpus_unparked;          // elastic grow events
+    uint64_t cpu_samples;
+    uint64_t cpu_samples_requested;  // taken early on request_cpu_sample
+    uint64_t sample_overhead_total_ns;
+    uint64_t sample_overhead_max_ns;
+    uint64_t sample_gap_max_ns;      // longest time placement ran on one sample
+    uint64_t sample_age_ns;          // age of the current sample when stats were read
+    int monitor_interval_ms;         // current, adaptive sampling interval
+    int packing;                     // placement currently packs rather than spreads
+    uint64_t placement_mode_switches;
+} LoadBalancerStats;
+
+struct LoadBalancer;
+
+typedef struct {
+    struct LoadBalancer* lb;
+    int cpu_id;
+    pthread_t thread;
+} LaneWorker;
+
+typedef struct LoadBalancer {
     LoadBalancerConfig* config;
     CPUMonitor* cpu_monitor;
     TaskQueue* task_queue;
+    TaskProfile* task_profile;
+    TimerWheel* timer_wheel;
+    AffinityTable* affinity_table;
+    LoadBalancerStats stats;
+    // CPUs in packing order: grouped by L3, lowest-numbered first
+    int* pack_order;
+    int packing;
     pthread_t monitor_thread;
+    // Monitor wakeups: periodic timerfd plus an eventfd for requests and shutdown
+    int monitor_epoll_fd;
+    int monitor_timer_fd;
+    int monitor_wake_fd;
+    int sample_requested;
+    int dispatched_since_sample;
+    uint64_t last_sample_ns;
     pthread_t scheduler_thread;
+    pthread_t timer_thread;
+    pthread_mutex_t timer_mutex;
+    pthread_cond_t timer_cond;
+    // Dispatched but unfinished tasks, guarded by active_tasks_mutex. Together
+    // with the live lane workers they keep a deferred cleanup from freeing lb.
+    pthread_mutex_t active_tasks_mutex;
+    pthread_cond_t active_tasks_cond;
+    int total_active_tasks;
+    Task* active_tasks;
+    int live_lane_workers;
+    int cleanup_pending;
+    // Low-latency lane for PRIORITY_CRITICAL on reserved cores
+    TaskRing* critical_ring;
+    LaneWorker* lane_workers;
+    int num_lane_workers;
+    int lane_running;
+    uint32_t lane_wake_seq;      // futex word idle workers park on
+    int lane_sleepers;
     int running;
 } LoadBalancer;
 
-LoadBalancer* init_load_balancer(LoadBalancerConfig* config);
-int submit_task(LoadBalancer* lb, void (*function)(void*), void* args, TaskPriority priority);
-void start_load_balancer(LoadBalancer* lb);
-void stop_load_balancer(LoadBalancer* lb);
-void* monitor_thread_func(void* arg);
-void* scheduler_thread_func(void* arg);
-int find_best_cpu(CPUMonitor* monitor);
-void wait_for_tasks_completion(LoadBalancer* lb);
-void cancel_pending_tasks(LoadBalancer* lb);
+CPUBALANCER_API LoadBalancer* init_load_balancer(LoadBalancerConfig* config);
+CPUBALANCER_API int submit_task(LoadBalancer* lb, void (*function)(void*), void* args, TaskPriority priority);
+CPUBALANCER_API int submit_task_ex(LoadBalancer* lb, void (*function)(void*), void* args,
+                                   TaskPriority priority, const TaskOptions* options);
+CPUBALANCER_API int try_submit_task(LoadBalancer* lb, void (*function)(void*), void* args, TaskPriority priority);
+CPUBALANCER_API int submit_task_timed(LoadBalancer* lb, void (*function)(void*), void* args,
+                                      TaskPriority priority, int timeout_ms);
+CPUBALANCER_API void set_backpressure_callback(LoadBalancer* lb, QueueWatermarkCallback callback, void* ctx);
+CPUBALANCER_API void start_load_balancer(LoadBalancer* lb);
+CPUBALANCER_API void stop_load_balancer(LoadBalancer* lb);
+CPUBALANCER_API void request_cpu_sample(LoadBalancer* lb);
+CPUBALANCER_API void wait_for_tasks_completion(LoadBalancer* lb);
+CPUBALANCER_API void cancel_pending_tasks(LoadBalancer* lb);
+CPUBALANCER_API int cancel_task(LoadBalancer* lb, int task_id);
+CPUBALANCER_API void cleanup_load_balancer(LoadBalancer* lb);
+CPUBALANCER_API int set_group_share(LoadBalancer* lb, int group_id, int weight, int max_concurrency);
+CPUBALANCER_API int get_group_stats(LoadBalancer* lb, TaskGroupStats* stats, int max_groups);
+CPUBALANCER_API void get_load_balancer_stats(LoadBalancer* lb, LoadBalancerStats* stats);
+CPUBALANCER_API void log_load_balancer_stats(LoadBalancer* lb);
 
 #endif
\ No newline at end of file
@@ -10,8 +10,8 @@ typedef enum {
     LOG_ERROR
 } LogLevel;
 
-void init_logger(const char* log_file, int detailed_logging);
-void log_message(LogLevel level, const char* format, ...);
-void cleanup_logger(void);
+void cpub_init_logger(const char* log_file, int detailed_logging);
+void cpub_log_message(LogLevel level, const char* format, ...);
+void cpub_cleanup_logger(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include "cpubalancer_export.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHM_RING_MAGIC 0x43504252u   // "CPBR"
+#define SHM_RING_VERSION 2
+// Smallest ring: a slot's in-progress sequence (pos + 2) must not reach the
+// value that frees it for the next lap (pos + capacity)
+#define SHM_RING_MIN_CAPACITY 4
+// cpub_shm_ring_pop results other than 0
+#define SHM_RING_EMPTY -1
+#define SHM_RING_CLAIMED -2       // next slot claimed, its producer hasn't started writing
+#define SHM_RING_WRITING -3       // next slot still being written
+// Sized so a ring slot, sequence included, spans four cache lines
+#define WORK_PAYLOAD_SIZE 200
+
+// A unit of work sent by a client process. The opcode selects the handler
+// registered with the server; everything else maps onto submit_task_ex.
+typedef struct {
+    uint32_t opcode;
+    uint32_t priority;            // TaskPriority
+    uint32_t payload_size;
+    int32_t timeout_ms;           // 0 for none
+    int32_t group_id;
+    uint32_t flags;               // reserved, must be 0
+    uint64_t affinity_key;        // 0 for none
+    uint64_t deadline_ns;         // absolute CLOCK_MONOTONIC, 0 for none
+    uint64_t tag;                 // opaque to the server, e.g. a client request id
+    unsigned char payload[WORK_PAYLOAD_SIZE];
+} WorkDescriptor;
+
+typedef struct {
+    uint64_t sequence;
+    WorkDescriptor work;
+} ShmRingSlot;
+
+// Bounded multi-producer/single-consumer ring laid out in a shared mapping.
+// Slots use the sequence protocol of TaskRing, plus a writing state
+// (pos + 2) that a producer CASes in before copying and out when publishing.
+// A producer that dies mid-push would otherwise stall the consumer at its
+// slot forever; instead the consumer may cpub_shm_ring_skip it, and a producer
+// that loses either CAS to a skip pushes again. Sleeping sides park on a
+// futex word that the other side bumps, and only when a waiter is registered,
+// so an uncontended push or pop makes no system call. Any process attached to
+// the mapping can write the header, so each side validates capacity once and
+// passes its own copy to every call rather than indexing by ring->capacity.
+typedef struct {
+    uint32_t magic;               // written last, once the ring is usable
+    uint32_t version;
+    uint32_t capacity;            // power of two
+    uint32_t slot_size;
+    _Alignas(64) uint64_t enqueue_pos;
+    _Alignas(64) uint64_t dequeue_pos;
+    _Alignas(64) uint32_t work_seq;          // bumped to wake the consumer
+    uint32_t consumer_waiting;
+    _Alignas(64) uint32_t space_seq;         // bumped to wake blocked producers
+    uint32_t producers_waiting;
+    _Alignas(64) ShmRingSlot slots[];
+} ShmRing;
+
+size_t cpub_shm_ring_bytes(uint32_t capacity);
+void cpub_shm_ring_format(ShmRing* ring, uint32_t capacity);
+int cpub_shm_ring_valid(const ShmRing* ring, size_t mapped_size, uint32_t* capacity);
+int cpub_shm_ring_push(ShmRing* ring, uint32_t capacity, const WorkDescriptor* work);
+int cpub_shm_ring_pop(ShmRing* ring, uint32_t capacity, WorkDescriptor* work);
+int cpub_shm_ring_skip(ShmRing* ring, uint32_t capacity);
+uint64_t cpub_shm_ring_head(ShmRing* ring);
+void cpub_shm_ring_wait_work(ShmRing* ring, uint32_t capacity, int timeout_ms);
+void cpub_shm_ring_wait_space(ShmRing* ring, uint32_t capacity, int timeout_ms);
+void cpub_shm_ring_wake_consumer(ShmRing* ring);
+CPUBALANCER_API int prepare_work(WorkDescriptor* work, uint32_t opcode, uint32_t priority,
+                                 const void* payload, size_t payload_size);
+
+#endif
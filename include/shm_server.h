@@ -0,0 +1,45 @@
+#ifndef SHM_SERVER_H
+#define SHM_SERVER_H
+
+#include "cpubalancer_export.h"
+#include "load_balancer.h"
+#include "shm_ring.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Opcodes index the handler table directly
+#define MAX_WORK_OPCODES 256
+// Client work may name task groups 0 .. MAX_CLIENT_GROUPS-1
+#define MAX_CLIENT_GROUPS 64
+
+// Runs as the body of a balancer task, so it may poll task_should_stop()
+typedef void (*WorkHandler)(const WorkDescriptor* work);
+
+// Owns the shared-memory ring that client processes submit to and turns
+// every descriptor into a submit_task_ex call on the local balancer
+typedef struct {
+    LoadBalancer* lb;
+    char* name;
+    ShmRing* ring;
+    uint32_t capacity;            // fixed at creation; clients can write the ring header
+    size_t mapped_size;
+    int lock_fd;                  // flock held on "<name>.lock" while serving
+    WorkHandler handlers[MAX_WORK_OPCODES];
+    pthread_t thread;
+    int running;
+    uint64_t work_received;
+    uint64_t work_rejected;       // unknown opcode or malformed descriptor
+    uint64_t submit_failures;     // refused by the balancer
+    uint64_t slots_skipped;       // claimed by a producer that never published
+    uint64_t stall_pos;           // ring position the drain thread is waiting on
+    uint64_t stall_since_ms;
+} ShmServer;
+
+CPUBALANCER_API ShmServer* init_shm_server(LoadBalancer* lb, const char* name, int capacity);
+CPUBALANCER_API int register_work_handler(ShmServer* server, uint32_t opcode, WorkHandler handler);
+CPUBALANCER_API int start_shm_server(ShmServer* server);
+CPUBALANCER_API void stop_shm_server(ShmServer* server);
+CPUBALANCER_API void cleanup_shm_server(ShmServer* server);
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef TASK_H
 #define TASK_H
 
+#include "cpubalancer_export.h"
 #include <pthread.h>
+#include <stdint.h>
 #include <time.h>
 
 typedef enum {
@@ -11,14 +13,29 @@ typedef enum {
     PRIORITY_CRITICAL = 3
 } TaskPriority;
 
+#define NUM_PRIORITIES 4
+
 typedef enum {
     STATUS_PENDING,
     STATUS_RUNNING,
     STATUS_COMPLETED,
-    STATUS_FAILED
+    STATUS_FAILED,
+    STATUS_CANCELLED
 } TaskStatus;
 
+typedef enum {
+    CANCEL_NONE = 0,
+    CANCEL_REQUESTED,
+    CANCEL_TIMEOUT,
+    CANCEL_SHUTDOWN
+} CancelReason;
+
+// Set once by the balancer; polled by the task body through task_should_stop()
 typedef struct {
+    int reason;
+} CancelToken;
+
+typedef struct Task {
     int task_id;
     TaskPriority priority;
     void (*function)(void*);
@@ -31,9 +48,54 @@ typedef struct {
     struct timespec end_time;
     double cpu_usage;
     double memory_usage;
+    struct timespec deadline;     // absolute CLOCK_MONOTONIC, zero when unset
+    int has_deadline;
+    int deadline_at_risk;         // admission predicted a miss
+    double predicted_ms;          // learned run time at submission, 0 if unknown
+    CancelToken cancel;
+    int timeout_ms;               // run-time limit, 0 for none
+    uint64_t affinity_key;        // tasks sharing a key prefer the same cache, 0 for none
+    int group_id;                 // tenant for fair-share scheduling
+    int holds_group_slot;         // counted against its group's concurrency cap
+    uint64_t cpu_time_ns;         // measured thread CPU time of the run
+    uint64_t charged_ns;          // run time already charged to its group
+    void (*on_drop)(void*);       // gets args back if the task is discarded unrun
+    uint64_t timer_expiry;        // timer wheel tick at which the timeout fires
+    struct Task* timer_prev;
+    struct Task* timer_next;
+    struct Task* active_prev;     // balancer's list of dispatched tasks
+    struct Task* active_next;
 } Task;
 
-Task* create_task(void (*function)(void*), void* args, TaskPriority priority);
-void free_task(Task* task);
+// Optional per-task submission parameters; a zeroed struct means "none"
+typedef struct {
+    struct timespec deadline;     // absolute CLOCK_MONOTONIC
+    int timeout_ms;               // cancel the task after it ran this long
+    uint64_t affinity_key;        // e.g. shard or session id, 0 for none
+    int group_id;                 // tenant/group for fair-share scheduling
+    // Called with args when an accepted task is shed, cancelled or failed
+    // before it ran, e.g. free for args the task body would have freed
+    void (*on_drop)(void* args);
+} TaskOptions;
+
+Task* cpub_create_task(void (*function)(void*), void* args, TaskPriority priority);
+void cpub_free_task(Task* task);
+void cpub_discard_task(Task* task, TaskStatus status);
+void cpub_set_task_deadline(Task* task, const struct timespec* deadline);
+int cpub_compare_task_deadlines(const Task* a, const Task* b);
+CPUBALANCER_API int request_task_cancel(Task* task, CancelReason reason);
+CPUBALANCER_API CancelReason task_cancel_reason(Task* task);
+void cpub_set_current_task(Task* task);
+CPUBALANCER_API Task* current_task(void);
+
+// Task running on this thread, NULL outside task bodies; use current_task()
+CPUBALANCER_API extern __thread Task* cpub_thread_current_task;
+
+// Cheap check for task bodies: non-zero once the running task was cancelled or
+// timed out. Inline so polling loops pay a TLS load and a relaxed read.
+static inline int task_should_stop(void) {
+    Task* task = cpub_thread_current_task;
+    return task && __atomic_load_n(&task->cancel.reason, __ATOMIC_ACQUIRE) != CANCEL_NONE;
+}
 
 #endif
\ No newline at end of file
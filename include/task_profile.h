@@ -0,0 +1,28 @@
+#ifndef TASK_PROFILE_H
+#define TASK_PROFILE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+// Number of completed runs before an estimate is trusted
+#define TASK_PROFILE_MIN_SAMPLES 3
+
+typedef struct {
+    void (*function)(void*);
+    double avg_runtime_ms;
+    uint64_t samples;
+} TaskProfileEntry;
+
+// Per-function run-time estimates, keyed by the task function pointer
+typedef struct {
+    TaskProfileEntry* entries;
+    int capacity;
+    pthread_mutex_t mutex;
+} TaskProfile;
+
+TaskProfile* cpub_init_task_profile(int capacity);
+void cpub_record_task_runtime(TaskProfile* profile, void (*function)(void*), double runtime_ms);
+double cpub_estimate_task_runtime(TaskProfile* profile, void (*function)(void*));
+void cpub_cleanup_task_profile(TaskProfile* profile);
+
+#endif
@@ -1,22 +1,113 @@
 #ifndef TASK_QUEUE_H
 #define TASK_QUEUE_H
 
+#include "config.h"
 #include "task.h"
+#include <stdint.h>
 
+// Weight of a group with a default share; vruntime advances at CPU time * unit / weight
+#define GROUP_WEIGHT_UNIT 1024
+
+typedef enum {
+    QUEUE_WATERMARK_NONE,
+    QUEUE_WATERMARK_HIGH,   // size rose to the high watermark
+    QUEUE_WATERMARK_LOW     // size fell back to the low watermark
+} QueueWatermarkEvent;
+
+typedef void (*QueueWatermarkCallback)(QueueWatermarkEvent event, int size, void* ctx);
+
+// Binary heap of pending tasks; the head is the next task to dispatch
 typedef struct {
     Task** tasks;
+    int size;
     int capacity;
+} TaskHeap;
+
+// A tenant's share of the queue. Groups are picked by lowest virtual runtime,
+// which grows with the CPU time their tasks consume divided by their weight.
+// Groups only created by a task's group_id are freed again once idle.
+typedef struct {
+    int group_id;
+    int weight;
+    int max_concurrency;      // 0 for unlimited
+    int running;              // dispatched and not yet completed
+    uint64_t vruntime;
+    int runnable_index;       // position in the runnable heap, -1 when not eligible
+    int configured;           // given a share explicitly, kept while idle
+    int waiting;              // producers blocked on admission
+    int refused;              // admission refused since the queue last drained
+    TaskHeap pending;
+    uint64_t tasks_run;
+    uint64_t usage_ns;
+    uint64_t total_wait_ns;
+    uint64_t max_wait_ns;
+} TaskGroup;
+
+typedef struct {
+    int group_id;
+    int weight;
+    int max_concurrency;
+    int running;
+    int queued;
+    uint64_t tasks_run;
+    uint64_t usage_ns;
+    uint64_t total_wait_ns;
+    uint64_t max_wait_ns;
+} TaskGroupStats;
+
+// Pending tasks, split into per-group heaps. Without fair share every task
+// lands in group 0 and the queue behaves as a single FIFO/EDF heap.
+typedef struct {
+    TaskGroup** groups;       // sorted by group_id
+    int num_groups;
+    int groups_capacity;
+    TaskGroup** runnable;     // min-heap on vruntime of groups that may dispatch
+    int num_runnable;
+    uint64_t min_vruntime;
+    int total_running;        // dispatched tasks holding a group slot
+    int max_running;          // 0 for unlimited
+    int fair_share;
+    int default_weight;
+    int initial_capacity;
+    int max_capacity;
     int size;
-    int front;
-    int rear;
+    double queued_work_ms;    // sum of predicted_ms over queued tasks
+    QueuePolicy policy;
+    int closed;
+    int high_watermark;
+    int low_watermark;
+    int above_high_watermark;
+    QueueWatermarkCallback watermark_callback;
+    void* watermark_ctx;
+    // Crossings are numbered under mutex and delivered under watermark_mutex,
+    // which drops any that arrive after a later one was already reported
+    uint64_t watermark_seq;
+    uint64_t watermark_delivered;
+    pthread_mutex_t watermark_mutex;
     pthread_mutex_t mutex;
     pthread_cond_t not_empty;
     pthread_cond_t not_full;
 } TaskQueue;
 
-TaskQueue* init_task_queue(int capacity);
-int enqueue_task(TaskQueue* queue, Task* task);
-Task* dequeue_task(TaskQueue* queue);
-void cleanup_task_queue(TaskQueue* queue);
+TaskQueue* cpub_init_task_queue(int capacity, int max_capacity, QueuePolicy policy);
+void cpub_set_queue_fair_share(TaskQueue* queue, int enabled, int default_weight, int max_running);
+int cpub_set_task_group_share(TaskQueue* queue, int group_id, int weight, int max_concurrency);
+int cpub_enqueue_task(TaskQueue* queue, Task* task);
+int cpub_try_enqueue_task(TaskQueue* queue, Task* task, Task** shed);
+int cpub_enqueue_task_timed(TaskQueue* queue, Task* task, const struct timespec* abstime);
+void cpub_set_queue_watermarks(TaskQueue* queue, int high, int low,
+                               QueueWatermarkCallback callback, void* ctx);
+Task* cpub_dequeue_task(TaskQueue* queue);
+Task* cpub_dequeue_task_if(TaskQueue* queue, int (*predicate)(Task*, void*), void* ctx);
+void cpub_charge_running_task(TaskQueue* queue, Task* task, uint64_t ran_ns);
+void cpub_complete_queued_task(TaskQueue* queue, Task* task);
+void cpub_release_queued_task(TaskQueue* queue, Task* task);
+int cpub_get_queue_size(TaskQueue* queue);
+double cpub_get_queued_work_ms(TaskQueue* queue);
+int cpub_get_task_group_stats(TaskQueue* queue, TaskGroupStats* stats, int max_groups);
+Task* cpub_remove_task_by_id(TaskQueue* queue, int task_id);
+Task* cpub_take_pending_task(TaskQueue* queue);
+void cpub_close_task_queue(TaskQueue* queue);
+void cpub_cleanup_task_queue(TaskQueue* queue);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,28 @@
+#ifndef TASK_RING_H
+#define TASK_RING_H
+
+#include "task.h"
+#include <stdint.h>
+
+typedef struct {
+    uint64_t sequence;
+    Task* task;
+} TaskRingCell;
+
+// Bounded lock-free multi-producer/multi-consumer ring of tasks. Each cell's
+// sequence number tells producers and consumers whose turn it is, so the
+// only shared writes are the two position counters, kept on separate lines.
+typedef struct {
+    TaskRingCell* cells;
+    uint64_t mask;
+    _Alignas(64) uint64_t enqueue_pos;
+    _Alignas(64) uint64_t dequeue_pos;
+} TaskRing;
+
+TaskRing* cpub_init_task_ring(int capacity);
+int cpub_task_ring_push(TaskRing* ring, Task* task);
+Task* cpub_task_ring_pop(TaskRing* ring);
+int cpub_task_ring_empty(TaskRing* ring);
+void cpub_cleanup_task_ring(TaskRing* ring);
+
+#endif
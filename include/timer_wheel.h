@@ -0,0 +1,27 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include "task.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#define TIMER_WHEEL_SLOTS 256
+
+// Hashed timing wheel for task timeouts. Each slot holds an intrusive list of
+// tasks; entries whose expiry lies further out simply survive a full rotation.
+typedef struct {
+    Task* slots[TIMER_WHEEL_SLOTS];
+    uint64_t current_tick;
+    int tick_ms;
+    struct timespec start_time;
+    pthread_mutex_t mutex;
+} TimerWheel;
+
+TimerWheel* cpub_init_timer_wheel(int tick_ms);
+void cpub_timer_wheel_add(TimerWheel* wheel, Task* task, int timeout_ms);
+void cpub_timer_wheel_remove(TimerWheel* wheel, Task* task);
+int cpub_timer_wheel_advance(TimerWheel* wheel);
+void cpub_cleanup_timer_wheel(TimerWheel* wheel);
+
+#endif
@@ -0,0 +1,58 @@
+#include "affinity_table.h"
+#include <stdlib.h>
+
+#define AFFINITY_CPU_BITS 16
+#define AFFINITY_CPU_MASK ((1ULL << AFFINITY_CPU_BITS) - 1)
+
+AffinityTable* cpub_init_affinity_table(int capacity) {
+    AffinityTable* table = malloc(sizeof(AffinityTable));
+    if (!table) return NULL;
+
+    // Round up to a power of two so the hash can be masked
+    uint64_t size = 1;
+    while (size < (uint64_t)capacity) size <<= 1;
+
+    table->slots = calloc(size, sizeof(uint64_t));
+    if (!table->slots) {
+        free(table);
+        return NULL;
+    }
+    table->mask = size - 1;
+
+    return table;
+}
+
+static uint64_t hash_key(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+// Returns the CPU that last ran this key, or -1
+int cpub_affinity_lookup(AffinityTable* table, uint64_t key) {
+    uint64_t hash = hash_key(key);
+    uint64_t entry = __atomic_load_n(&table->slots[hash & table->mask], __ATOMIC_RELAXED);
+
+    if (entry == 0 || (entry >> AFFINITY_CPU_BITS) != (hash >> AFFINITY_CPU_BITS)) {
+        return -1;
+    }
+    return (int)(entry & AFFINITY_CPU_MASK) - 1;
+}
+
+void cpub_affinity_update(AffinityTable* table, uint64_t key, int cpu_id) {
+    uint64_t hash = hash_key(key);
+    uint64_t entry = (hash & ~AFFINITY_CPU_MASK) | ((uint64_t)(cpu_id + 1) & AFFINITY_CPU_MASK);
+    __atomic_store_n(&table->slots[hash & table->mask], entry, __ATOMIC_RELAXED);
+}
+
+void cpub_cleanup_affinity_table(AffinityTable* table) {
+    if (table == NULL) {
+        return;
+    }
+
+    free(table->slots);
+    free(table);
+}
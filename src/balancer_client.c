@@ -0,0 +1,88 @@
+#include "balancer_client.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Returns NULL with errno set; EPROTO means the object is not a usable ring
+BalancerClient* balancer_client_connect(const char* name) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void* mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    uint32_t capacity;
+    if (!cpub_shm_ring_valid(mapping, st.st_size, &capacity)) {
+        munmap(mapping, st.st_size);
+        errno = EPROTO;
+        return NULL;
+    }
+
+    BalancerClient* client = malloc(sizeof(BalancerClient));
+    if (!client) {
+        munmap(mapping, st.st_size);
+        return NULL;
+    }
+    client->ring = mapping;
+    client->capacity = capacity;
+    client->mapped_size = st.st_size;
+    return client;
+}
+
+static long remaining_ms(const struct timespec* deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (deadline->tv_sec - now.tv_sec) * 1000 + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+}
+
+// Waits up to timeout_ms for a free slot when the ring is full: 0 fails
+// immediately, negative waits indefinitely. Returns -1 with errno EAGAIN on
+// timeout, 0 once the work is queued.
+int balancer_client_submit(BalancerClient* client, const WorkDescriptor* work, int timeout_ms) {
+    if (work->payload_size > WORK_PAYLOAD_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while (cpub_shm_ring_push(client->ring, client->capacity, work) != 0) {
+        long wait_ms = -1;
+        if (timeout_ms >= 0) {
+            wait_ms = remaining_ms(&deadline);
+            if (wait_ms <= 0) {
+                errno = EAGAIN;
+                return -1;
+            }
+        }
+        cpub_shm_ring_wait_space(client->ring, client->capacity, (int)wait_ms);
+    }
+    return 0;
+}
+
+void balancer_client_disconnect(BalancerClient* client) {
+    if (client == NULL) {
+        return;
+    }
+
+    munmap(client->ring, client->mapped_size);
+    free(client);
+}
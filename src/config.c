@@ -9,6 +9,9 @@ LoadBalancerConfig* init_default_config(void) {
     
     config->max_tasks = 10;
     config->monitoring_interval_ms = 100;
+    config->max_monitoring_interval_ms = 1000;
+    config->min_sample_gap_ms = 10;
+    config->stable_load_delta = 5.0;
     config->high_load_threshold = 80.0;
     config->low_load_threshold = 20.0;
     config->load_history_size = 10;
@@ -17,6 +20,36 @@ LoadBalancerConfig* init_default_config(void) {
     config->log_file_path = strdup("./cpu_balancer.log");
     config->rebalance_threshold = 30;
     config->min_task_runtime_ms = 5;
+    config->coalesce_batch_size = 8;
+    config->inline_queue_depth = 32;
+    config->queue_policy = QUEUE_POLICY_FIFO;
+    config->deadline_admission = DEADLINE_ADMISSION_FLAG;
+    config->overload_policy = OVERLOAD_BLOCK;
+    config->max_queue_capacity = 1024;
+    config->queue_high_watermark = 768;
+    config->queue_low_watermark = 256;
+    config->timer_tick_ms = 10;
+    config->shutdown_grace_ms = 2000;
+    config->critical_lane_cpu_mask = 0;
+    config->critical_ring_size = 1024;
+    config->critical_spin_count = 20000;
+    config->affinity_table_size = 4096;
+    config->affinity_load_margin = 20.0;
+    config->enable_fair_share = 0;
+    config->default_group_weight = 1024;
+    config->max_running_tasks = 0;
+    config->placement_mode = PLACEMENT_SPREAD;
+    config->pack_target_utilization = 70.0;
+    config->shm_ring_name = strdup("/cpu_balancer");
+    config->shm_ring_size = 4096;
+    config->proc_root = strdup("/proc");
+    config->sysfs_root = strdup("/sys");
+    config->thermal_limit_c = 85.0;
+    config->enable_elastic_cpus = 0;
+    config->min_active_cpus = 1;
+    config->psi_high_threshold = 25.0;
+    config->psi_low_threshold = 5.0;
+    config->elastic_hysteresis_samples = 5;
     
     return config;
 }
@@ -29,6 +62,9 @@ LoadBalancerConfig* load_config(const char* config_path) {
 void free_config(LoadBalancerConfig* config) {
     if (config) {
         free(config->log_file_path);
+        free(config->shm_ring_name);
+        free(config->proc_root);
+        free(config->sysfs_root);
         free(config);
     }
 }
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "load_balancer.h"
+#include "shm_server.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+// Demo opcodes served by this daemon
+#define OP_LOG 1    // payload: NUL-terminated message
+#define OP_SPIN 2   // payload: uint32_t milliseconds of CPU work
+
+static volatile sig_atomic_t running = 1;
+
+static void signal_handler(int signum) {
+    (void)signum;
+    running = 0;
+}
+
+static void handle_log(const WorkDescriptor* work) {
+    cpub_log_message(LOG_INFO, "Client work %lu: %.*s", work->tag,
+                     (int)strnlen((const char*)work->payload, work->payload_size), work->payload);
+}
+
+static void handle_spin(const WorkDescriptor* work) {
+    uint32_t duration_ms = 0;
+    if (work->payload_size >= sizeof(duration_ms)) {
+        memcpy(&duration_ms, work->payload, sizeof(duration_ms));
+    }
+
+    struct timespec start, now;
+    volatile double result = 0.0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        for (int i = 0; i < 10000; i++) {
+            result += i * 0.5;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (!task_should_stop() &&
+             (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 < duration_ms);
+}
+
+int main(int argc, char** argv) {
+    int max_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_cores = argc > 1 ? atoi(argv[1]) : max_cores;
+
+    if (num_cores < 1 || num_cores > max_cores) {
+        fprintf(stderr, "Usage: %s [num_cores] [shm_name]\n", argv[0]);
+        fprintf(stderr, "  num_cores: Number of CPU cores to use (1-%d)\n", max_cores);
+        return 1;
+    }
+
+    LoadBalancerConfig* config = init_default_config();
+    if (!config) {
+        fprintf(stderr, "Failed to initialize configuration\n");
+        return 1;
+    }
+    config->num_cpus = num_cores;
+    config->enable_detailed_logging = 0;
+    if (argc > 2) {
+        free(config->shm_ring_name);
+        config->shm_ring_name = strdup(argv[2]);
+    }
+
+    LoadBalancer* lb = init_load_balancer(config);
+    if (!lb) {
+        fprintf(stderr, "Failed to initialize load balancer\n");
+        free_config(config);
+        return 1;
+    }
+
+    ShmServer* server = init_shm_server(lb, config->shm_ring_name, config->shm_ring_size);
+    if (!server) {
+        fprintf(stderr, "Failed to create work ring %s\n", config->shm_ring_name);
+        cleanup_load_balancer(lb);
+        free_config(config);
+        return 1;
+    }
+    register_work_handler(server, OP_LOG, handle_log);
+    register_work_handler(server, OP_SPIN, handle_spin);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = signal_handler;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    start_load_balancer(lb);
+    start_shm_server(server);
+    cpub_log_message(LOG_INFO, "cpu_balancerd serving %s on %d cores", config->shm_ring_name, num_cores);
+
+    while (running) {
+        sleep(1);
+    }
+
+    cpub_log_message(LOG_INFO, "Received shutdown signal, initiating graceful shutdown");
+    stop_shm_server(server);
+    stop_load_balancer(lb);
+    cleanup_shm_server(server);
+    cleanup_load_balancer(lb);
+    free_config(config);
+    return 0;
+}
@@ -4,13 +4,34 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <dirent.h>
 
-CPUMonitor* init_cpu_monitor(LoadBalancerConfig* config) {
+// cacheN/indexM directories examined per CPU
+#define MAX_CACHE_INDEX 8
+// Core sensors examined per coretemp device
+#define MAX_HWMON_SENSORS 128
+// Capacity lost per degree above thermal_limit_c, and the floor it stops at
+#define THERMAL_DERATE_PER_C 0.05
+#define MIN_THERMAL_FACTOR 0.25
+// Lowest capacity placement will divide by
+#define MIN_CPU_CAPACITY 0.05
+
+CPUMonitor* cpub_init_cpu_monitor(LoadBalancerConfig* config) {
     CPUMonitor* monitor = malloc(sizeof(CPUMonitor));
     if (!monitor) return NULL;
     
     monitor->num_cpus = config->num_cpus;
     monitor->config = config;
+    monitor->cpu_pressure = -1.0;
+    monitor->foreign_share = -1.0;
+    monitor->host_pressure = -1.0;
+    monitor->own_cpu_ticks = 0;
+    monitor->own_sampled = 0;
+    monitor->contended_samples = 0;
+    monitor->idle_samples = 0;
+    monitor->pressure_warned = 0;
+    monitor->cpus_parked = 0;
+    monitor->cpus_unparked = 0;
     monitor->stats = malloc(sizeof(CPUStats) * monitor->num_cpus);
     
     if (!monitor->stats) {
@@ -21,19 +42,299 @@ CPUMonitor* init_cpu_monitor(LoadBalancerConfig* config) {
     for (int i = 0; i < monitor->num_cpus; i++) {
         monitor->stats[i].cpu_id = i;
         monitor->stats[i].current_usage = 0.0;
+        monitor->stats[i].user_time = monitor->stats[i].nice_time = 0;
+        monitor->stats[i].system_time = monitor->stats[i].idle_time = 0;
+        monitor->stats[i].iowait_time = monitor->stats[i].irq_time = 0;
+        monitor->stats[i].softirq_time = monitor->stats[i].steal_time = 0;
         monitor->stats[i].usage_history = malloc(sizeof(double) * config->load_history_size);
         monitor->stats[i].history_index = 0;
         monitor->stats[i].active_tasks = 0;
+        monitor->stats[i].reserved = 0;
+        monitor->stats[i].l2_domain = -1;
+        monitor->stats[i].l3_domain = -1;
+        monitor->stats[i].parked = 0;
+        monitor->stats[i].temperature = 0.0;
+        monitor->stats[i].temp_path = NULL;
+        monitor->stats[i].core_id = -1;
+        monitor->stats[i].package_id = -1;
+        monitor->stats[i].max_freq_khz = 0;
+        monitor->stats[i].cur_freq_khz = 0;
+        monitor->stats[i].base_capacity = 1.0;
+        monitor->stats[i].capacity = 1.0;
         memset(monitor->stats[i].usage_history, 0, sizeof(double) * config->load_history_size);
     }
     
+    cpub_load_cpu_topology(monitor);
     return monitor;
 }
 
-void update_cpu_stats(CPUMonitor* monitor) {
-    FILE* fp = fopen("/proc/stat", "r");
+static int read_sysfs_int(const char* path, int* value) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return -1;
+    int ok = fscanf(fp, "%d", value) == 1;
+    fclose(fp);
+    return ok ? 0 : -1;
+}
+
+static void find_temperature_sensors(CPUMonitor* monitor);
+
+static int read_sysfs_string(const char* path, char* buf, size_t len) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return -1;
+    char* ok = fgets(buf, len, fp);
+    fclose(fp);
+    if (!ok) return -1;
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+// Fills the cache domains, core and package ids, and the static part of each
+// CPU's capacity. Cache domain ids are the first CPU of shared_cpu_list, so
+// siblings compare equal. Base capacity comes from cpu_capacity (1024 = the
+// biggest core) where the kernel exports it, else from cpuinfo_max_freq
+// relative to the fastest CPU, so hybrid parts rank their small cores lower.
+void cpub_load_cpu_topology(CPUMonitor* monitor) {
+    const char* root = monitor->config->sysfs_root;
+    char path[512];
+    int fastest_khz = 0, have_capacity = 0;
+
+    for (int i = 0; i < monitor->num_cpus; i++) {
+        CPUStats* cpu = &monitor->stats[i];
+
+        for (int index = 0; index < MAX_CACHE_INDEX; index++) {
+            int level, first_cpu;
+            snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/cache/index%d/level",
+                     root, i, index);
+            if (read_sysfs_int(path, &level) != 0) break;
+
+            snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",
+                     root, i, index);
+            if (read_sysfs_int(path, &first_cpu) != 0) continue;
+
+            if (level == 2) cpu->l2_domain = first_cpu;
+            if (level == 3) cpu->l3_domain = first_cpu;
+        }
+
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/topology/core_id", root, i);
+        read_sysfs_int(path, &cpu->core_id);
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/topology/physical_package_id", root, i);
+        read_sysfs_int(path, &cpu->package_id);
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", root, i);
+        if (read_sysfs_int(path, &cpu->max_freq_khz) == 0 && cpu->max_freq_khz > fastest_khz) {
+            fastest_khz = cpu->max_freq_khz;
+        }
+
+        int capacity;
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/cpu_capacity", root, i);
+        if (read_sysfs_int(path, &capacity) == 0 && capacity > 0) {
+            cpu->base_capacity = capacity / 1024.0;
+            have_capacity = 1;
+        }
+    }
+
+    for (int i = 0; i < monitor->num_cpus && !have_capacity && fastest_khz > 0; i++) {
+        CPUStats* cpu = &monitor->stats[i];
+        if (cpu->max_freq_khz > 0) {
+            cpu->base_capacity = (double)cpu->max_freq_khz / fastest_khz;
+        }
+    }
+    for (int i = 0; i < monitor->num_cpus; i++) {
+        monitor->stats[i].capacity = monitor->stats[i].base_capacity;
+    }
+
+    find_temperature_sensors(monitor);
+}
+
+// Gives zone_temp to every CPU in cpu's cpufreq policy (related_cpus, e.g.
+// "0 1 2 3" or "0-3") that no core sensor covers
+static void assign_zone_to_policy(CPUMonitor* monitor, int cpu, const char* zone_temp) {
+    char path[512], list[256];
+    snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/cpufreq/related_cpus",
+             monitor->config->sysfs_root, cpu);
+    if (read_sysfs_string(path, list, sizeof(list)) != 0) {
+        snprintf(list, sizeof(list), "%d", cpu);
+    }
+
+    char* save;
+    for (char* token = strtok_r(list, " ,", &save); token; token = strtok_r(NULL, " ,", &save)) {
+        int first, last;
+        int fields = sscanf(token, "%d-%d", &first, &last);
+        if (fields < 1) continue;
+        if (fields == 1) last = first;
+        for (int i = first; i <= last && i < monitor->num_cpus; i++) {
+            if (i >= 0 && !monitor->stats[i].temp_path) {
+                monitor->stats[i].temp_path = strdup(zone_temp);
+            }
+        }
+    }
+}
+
+// Finds, once, each CPU's coretemp input ("Core N" labels, matched on core_id
+// within the device's "Package id P"), so sampling only reads known files.
+// CPUs without one take the thermal zone bound to their cpufreq cooling device
+// (cdevN/type "cpufreq-cpuM"), which covers every CPU in M's policy. Zones
+// that can't be tied to a CPU are ignored: a hot package or chipset zone would
+// otherwise derate cores it doesn't measure.
+static void find_temperature_sensors(CPUMonitor* monitor) {
+    const char* root = monitor->config->sysfs_root;
+    char dir_path[512], path[512], label[64];
+    struct dirent* entry;
+    int dev;
+
+    snprintf(dir_path, sizeof(dir_path), "%s/class/hwmon", root);
+    DIR* hwmon = opendir(dir_path);
+    while (hwmon && (entry = readdir(hwmon)) != NULL) {
+        if (sscanf(entry->d_name, "hwmon%d", &dev) != 1) continue;
+        snprintf(path, sizeof(path), "%s/class/hwmon/hwmon%d/name", root, dev);
+        if (read_sysfs_string(path, label, sizeof(label)) != 0) continue;
+        if (strcmp(label, "coretemp") != 0) continue;
+
+        int package = -1, sensors = 0;
+        int core_ids[MAX_HWMON_SENSORS];
+        int inputs[MAX_HWMON_SENSORS];
+        snprintf(path, sizeof(path), "%s/class/hwmon/hwmon%d", root, dev);
+        DIR* device = opendir(path);
+        while (device && (entry = readdir(device)) != NULL && sensors < MAX_HWMON_SENSORS) {
+            int sensor, id;
+            char suffix[8];
+            if (sscanf(entry->d_name, "temp%d_%7s", &sensor, suffix) != 2 ||
+                strcmp(suffix, "label") != 0) {
+                continue;
+            }
+            snprintf(path, sizeof(path), "%s/class/hwmon/hwmon%d/temp%d_label", root, dev, sensor);
+            if (read_sysfs_string(path, label, sizeof(label)) != 0) continue;
+
+            if (sscanf(label, "Package id %d", &id) == 1) {
+                package = id;
+            } else if (sscanf(label, "Core %d", &id) == 1) {
+                core_ids[sensors] = id;
+                inputs[sensors++] = sensor;
+            }
+        }
+        if (device) closedir(device);
+
+        for (int i = 0; i < monitor->num_cpus; i++) {
+            CPUStats* cpu = &monitor->stats[i];
+            if (cpu->temp_path || cpu->core_id < 0 ||
+                (package >= 0 && cpu->package_id != package)) {
+                continue;
+            }
+            for (int j = 0; j < sensors; j++) {
+                if (core_ids[j] == cpu->core_id) {
+                    snprintf(path, sizeof(path), "%s/class/hwmon/hwmon%d/temp%d_input",
+                             root, dev, inputs[j]);
+                    cpu->temp_path = strdup(path);
+                    break;
+                }
+            }
+        }
+    }
+    if (hwmon) closedir(hwmon);
+
+    snprintf(dir_path, sizeof(dir_path), "%s/class/thermal", root);
+    DIR* thermal = opendir(dir_path);
+    while (thermal && (entry = readdir(thermal)) != NULL) {
+        if (sscanf(entry->d_name, "thermal_zone%d", &dev) != 1) continue;
+
+        char zone_temp[512];
+        snprintf(zone_temp, sizeof(zone_temp), "%s/class/thermal/thermal_zone%d/temp", root, dev);
+        snprintf(path, sizeof(path), "%s/class/thermal/thermal_zone%d", root, dev);
+        DIR* zone = opendir(path);
+        struct dirent* link;
+        while (zone && (link = readdir(zone)) != NULL) {
+            int cdev, cpu, end = 0;
+            // cdevN only; cdevN_trip_point and cdevN_weight are attributes
+            if (sscanf(link->d_name, "cdev%d%n", &cdev, &end) != 1 || link->d_name[end] != '\0') {
+                continue;
+            }
+            snprintf(path, sizeof(path), "%s/class/thermal/thermal_zone%d/cdev%d/type",
+                     root, dev, cdev);
+            if (read_sysfs_string(path, label, sizeof(label)) == 0 &&
+                sscanf(label, "cpufreq-cpu%d", &cpu) == 1) {
+                assign_zone_to_policy(monitor, cpu, zone_temp);
+            }
+        }
+        if (zone) closedir(zone);
+    }
+    if (thermal) closedir(thermal);
+}
+
+// Reads each CPU's sensor. CPUs without one stay at 0 and are never derated.
+static void update_cpu_temperatures(CPUMonitor* monitor) {
+    int value;
+
+    for (int i = 0; i < monitor->num_cpus; i++) {
+        CPUStats* cpu = &monitor->stats[i];
+        if (cpu->temp_path && read_sysfs_int(cpu->temp_path, &value) == 0) {
+            cpu->temperature = value / 1000.0;
+        } else {
+            cpu->temperature = 0.0;
+        }
+    }
+}
+
+// Scales base_capacity by how far a busy core is clocked below its maximum
+// (throttling shows up here; idle cores are not penalised for sitting at a low
+// P-state) and derates cores running above thermal_limit_c.
+void cpub_update_cpu_capacity(CPUMonitor* monitor) {
+    LoadBalancerConfig* config = monitor->config;
+    char path[512];
+
+    update_cpu_temperatures(monitor);
+
+    for (int i = 0; i < monitor->num_cpus; i++) {
+        CPUStats* cpu = &monitor->stats[i];
+        double capacity = cpu->base_capacity;
+
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq",
+                 config->sysfs_root, i);
+        if (read_sysfs_int(path, &cpu->cur_freq_khz) != 0) {
+            cpu->cur_freq_khz = 0;
+        }
+        if (cpu->max_freq_khz > 0 && cpu->cur_freq_khz > 0 &&
+            cpu->cur_freq_khz < cpu->max_freq_khz &&
+            cpu->current_usage >= config->low_load_threshold) {
+            capacity *= (double)cpu->cur_freq_khz / cpu->max_freq_khz;
+        }
+
+        if (cpu->temperature > config->thermal_limit_c) {
+            double factor = 1.0 - THERMAL_DERATE_PER_C * (cpu->temperature - config->thermal_limit_c);
+            capacity *= factor > MIN_THERMAL_FACTOR ? factor : MIN_THERMAL_FACTOR;
+        }
+
+        cpu->capacity = capacity > MIN_CPU_CAPACITY ? capacity : MIN_CPU_CAPACITY;
+    }
+}
+
+// CPU time this process has used, in the same clock ticks as /proc/stat
+static int read_own_cpu_ticks(CPUMonitor* monitor, uint64_t* ticks) {
+    char path[256], line[1024];
+    snprintf(path, sizeof(path), "%s/self/stat", monitor->config->proc_root);
+
+    FILE* fp = fopen(path, "r");
+    if (!fp) return -1;
+    char* ok = fgets(line, sizeof(line), fp);
+    fclose(fp);
+
+    // The command name may hold spaces; fields resume after its closing paren
+    char* rest = ok ? strrchr(line, ')') : NULL;
+    uint64_t utime, stime;
+    if (!rest || sscanf(rest + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                        &utime, &stime) != 2) {
+        return -1;
+    }
+    *ticks = utime + stime;
+    return 0;
+}
+
+void cpub_update_cpu_stats(CPUMonitor* monitor) {
+    char path[256];
+    uint64_t busy_ticks = 0, own_ticks = 0;
+    snprintf(path, sizeof(path), "%s/stat", monitor->config->proc_root);
+
+    FILE* fp = fopen(path, "r");
     if (!fp) {
-        log_message(LOG_ERROR, "Failed to open /proc/stat");
+        cpub_log_message(LOG_ERROR, "Failed to open %s", path);
         return;
     }
     
@@ -63,8 +364,10 @@ void update_cpu_stats(CPUMonitor* monitor) {
             
             uint64_t total_delta = total_time - prev_total;
             uint64_t idle_delta = idle_time - prev_idle;
+            if (total_delta == 0) continue;  // no tick since the previous sample
             
             cpu->current_usage = 100.0 * (1.0 - ((double)idle_delta / total_delta));
+            busy_ticks += total_delta - idle_delta;
             
             // Update history
             cpu->usage_history[cpu->history_index] = cpu->current_usage;
@@ -81,15 +384,143 @@ void update_cpu_stats(CPUMonitor* monitor) {
             cpu->steal_time = steal;
             
             if (monitor->config->enable_load_prediction) {
-                cpu->predicted_load = predict_cpu_load(cpu);
+                cpu->predicted_load = cpub_predict_cpu_load(cpu);
             }
         }
     }
     
     fclose(fp);
+
+    // How much of the CPUs' busy time was someone else's tells our own
+    // contention apart from the host's
+    if (read_own_cpu_ticks(monitor, &own_ticks) != 0) {
+        monitor->own_sampled = 0;
+        monitor->foreign_share = -1.0;
+        return;
+    }
+    if (monitor->own_sampled && busy_ticks > 0) {
+        uint64_t own_delta = own_ticks - monitor->own_cpu_ticks;
+        double foreign = 1.0 - (double)own_delta / busy_ticks;
+        monitor->foreign_share = foreign > 0.0 ? foreign : 0.0;
+    }
+    monitor->own_cpu_ticks = own_ticks;
+    monitor->own_sampled = 1;
 }
 
-double predict_cpu_load(CPUStats* cpu) {
+// Reads the "some avg10" figure of the CPU pressure stall information: the
+// share of the last 10s in which at least one runnable task waited for a CPU
+int cpub_read_cpu_pressure(CPUMonitor* monitor, double* some_avg10) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/pressure/cpu", monitor->config->proc_root);
+
+    FILE* fp = fopen(path, "r");
+    if (!fp) return -1;
+    int ok = fscanf(fp, "some avg10=%lf", some_avg10) == 1;
+    fclose(fp);
+    return ok ? 0 : -1;
+}
+
+int cpub_cpu_available(CPUMonitor* monitor, int cpu_id) {
+    CPUStats* cpu = &monitor->stats[cpu_id];
+    return !cpu->reserved && !__atomic_load_n(&cpu->parked, __ATOMIC_RELAXED);
+}
+
+int cpub_count_active_cpus(CPUMonitor* monitor) {
+    int active = 0;
+    for (int i = 0; i < monitor->num_cpus; i++) {
+        if (cpub_cpu_available(monitor, i)) active++;
+    }
+    return active;
+}
+
+// Yields the highest-numbered active CPU when the host is contended (pressure
+// above psi_high_threshold while our cores are busy) and reclaims the
+// lowest-numbered parked CPU once pressure falls below psi_low_threshold.
+// Either condition must hold for elastic_hysteresis_samples consecutive calls.
+// "some" pressure is host-wide. While an active CPU runs more than one of our
+// tasks, our own threads keep it high, so only the part matching other
+// processes' share of the busy CPU time counts; parking would otherwise feed
+// on the backlog it creates. Returns the change in active CPUs.
+int cpub_update_elastic_cpus(CPUMonitor* monitor) {
+    LoadBalancerConfig* config = monitor->config;
+    double pressure;
+
+    if (cpub_read_cpu_pressure(monitor, &pressure) != 0) {
+        // Without a pressure signal, fall back to the full CPU set
+        if (!monitor->pressure_warned) {
+            cpub_log_message(LOG_WARNING, "CPU pressure unavailable under %s, elastic CPUs inactive",
+                             config->proc_root);
+            monitor->pressure_warned = 1;
+        }
+        int unparked = 0;
+        for (int i = 0; i < monitor->num_cpus; i++) {
+            if (monitor->stats[i].parked) {
+                __atomic_store_n(&monitor->stats[i].parked, 0, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&monitor->cpus_unparked, 1, __ATOMIC_RELAXED);
+                unparked++;
+            }
+        }
+        monitor->cpu_pressure = -1.0;
+        monitor->host_pressure = -1.0;
+        monitor->contended_samples = 0;
+        monitor->idle_samples = 0;
+        return unparked;
+    }
+    monitor->pressure_warned = 0;
+    monitor->cpu_pressure = pressure;
+
+    int active = 0, parked = -1, victim = -1, oversubscribed = 0;
+    double usage = 0.0;
+    for (int i = 0; i < monitor->num_cpus; i++) {
+        CPUStats* cpu = &monitor->stats[i];
+        if (cpu->reserved) continue;
+        if (cpu->parked) {
+            if (parked < 0) parked = i;
+            continue;
+        }
+        active++;
+        usage += cpu->current_usage;
+        if (__atomic_load_n(&cpu->active_tasks, __ATOMIC_RELAXED) > 1) oversubscribed = 1;
+        victim = i;
+    }
+    if (active > 0) usage /= active;
+
+    // Our own waiting threads inflate pressure on an oversubscribed CPU; count
+    // only other processes' share of it, or none when that share is unknown
+    double host_pressure = pressure;
+    if (oversubscribed) {
+        host_pressure = monitor->foreign_share >= 0 ? pressure * monitor->foreign_share : 0.0;
+    }
+    monitor->host_pressure = host_pressure;
+
+    int contended = host_pressure > config->psi_high_threshold &&
+                    usage >= config->low_load_threshold &&
+                    active > config->min_active_cpus && active > 1;
+    int idle = pressure < config->psi_low_threshold && parked >= 0;
+
+    monitor->contended_samples = contended ? monitor->contended_samples + 1 : 0;
+    monitor->idle_samples = idle ? monitor->idle_samples + 1 : 0;
+
+    if (monitor->contended_samples >= config->elastic_hysteresis_samples) {
+        monitor->contended_samples = 0;
+        __atomic_store_n(&monitor->stats[victim].parked, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&monitor->cpus_parked, 1, __ATOMIC_RELAXED);
+        cpub_log_message(LOG_INFO, "Parked CPU %d: pressure %.2f%% (%.2f%% not ours), usage %.1f%%, "
+                         "%d CPUs active", victim, pressure, host_pressure, usage, active - 1);
+        return -1;
+    }
+    if (monitor->idle_samples >= config->elastic_hysteresis_samples) {
+        monitor->idle_samples = 0;
+        __atomic_store_n(&monitor->stats[parked].parked, 0, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&monitor->cpus_unparked, 1, __ATOMIC_RELAXED);
+        cpub_log_message(LOG_INFO, "Unparked CPU %d: pressure %.2f%%, %d CPUs active",
+                         parked, pressure, active + 1);
+        return 1;
+    }
+    return 0;
+}
+
+double cpub_predict_cpu_load(CPUStats* cpu) {
     // Simple moving average prediction
     double sum = 0.0;
     int count = 0;
@@ -103,47 +534,62 @@ double predict_cpu_load(CPUStats* cpu) {
 }
 
 
-void print_cpu_stats(CPUMonitor* monitor) {
+// Writes a human-readable report to out; the library itself never writes to a terminal
+void print_cpu_stats(CPUMonitor* monitor, FILE* out) {
     if (monitor == NULL || monitor->stats == NULL) {
-        printf("CPUMonitor is not initialized.\n");
+        fprintf(out, "CPUMonitor is not initialized.\n");
         return;
     }
 
-    printf("CPU Usage Statistics:\n");
-    printf("------------------------------------------------------------\n");
+    fprintf(out, "CPU Usage Statistics:\n");
+    fprintf(out, "------------------------------------------------------------\n");
 
     for (int i = 0; i < monitor->num_cpus; ++i) {
         CPUStats* cpu = &monitor->stats[i];
         
-        printf("CPU ID: %d\n", cpu->cpu_id);
-        printf("  Current Usage: %.2f%%\n", cpu->current_usage);
-        printf("  User Time: %lu\n", cpu->user_time);
-        printf("  Nice Time: %lu\n", cpu->nice_time);
-        printf("  System Time: %lu\n", cpu->system_time);
-        printf("  Idle Time: %lu\n", cpu->idle_time);
-        printf("  IOWait Time: %lu\n", cpu->iowait_time);
-        printf("  IRQ Time: %lu\n", cpu->irq_time);
-        printf("  SoftIRQ Time: %lu\n", cpu->softirq_time);
-        printf("  Steal Time: %lu\n", cpu->steal_time);
-        printf("  Temperature: %.2f°C\n", cpu->temperature);
-        printf("  Predicted Load: %.2f%%\n", cpu->predicted_load);
-        printf("  Active Tasks: %d\n", cpu->active_tasks);
+        fprintf(out, "CPU ID: %d\n", cpu->cpu_id);
+        fprintf(out, "  Current Usage: %.2f%%\n", cpu->current_usage);
+        fprintf(out, "  User Time: %lu\n", cpu->user_time);
+        fprintf(out, "  Nice Time: %lu\n", cpu->nice_time);
+        fprintf(out, "  System Time: %lu\n", cpu->system_time);
+        fprintf(out, "  Idle Time: %lu\n", cpu->idle_time);
+        fprintf(out, "  IOWait Time: %lu\n", cpu->iowait_time);
+        fprintf(out, "  IRQ Time: %lu\n", cpu->irq_time);
+        fprintf(out, "  SoftIRQ Time: %lu\n", cpu->softirq_time);
+        fprintf(out, "  Steal Time: %lu\n", cpu->steal_time);
+        fprintf(out, "  Temperature: %.2f°C\n", cpu->temperature);
+        fprintf(out, "  Frequency: %d / %d kHz\n", cpu->cur_freq_khz, cpu->max_freq_khz);
+        fprintf(out, "  Capacity: %.2f\n", cpu->capacity);
+        fprintf(out, "  Predicted Load: %.2f%%\n", cpu->predicted_load);
+        fprintf(out, "  Active Tasks: %d\n", cpu->active_tasks);
         
         if (cpu->usage_history != NULL) {
-            printf("  Usage History (last 5 samples): ");
+            fprintf(out, "  Usage History (last 5 samples): ");
             for (int j = 0; j < 5 && j < cpu->history_index; ++j) {
-                printf("%.2f%% ", cpu->usage_history[j]);
+                fprintf(out, "%.2f%% ", cpu->usage_history[j]);
             }
-            printf("\n");
+            fprintf(out, "\n");
         }
 
-        printf("------------------------------------------------------------\n");
+        fprintf(out, "------------------------------------------------------------\n");
+    }
+}
+
+// One line per CPU at LOG_DEBUG, used by the monitor when detailed logging is on
+void cpub_log_cpu_stats(CPUMonitor* monitor) {
+    for (int i = 0; i < monitor->num_cpus; ++i) {
+        CPUStats* cpu = &monitor->stats[i];
+        cpub_log_message(LOG_DEBUG, "CPU %d: usage %.2f%%, predicted %.2f%%, active tasks %d, "
+                         "capacity %.2f, %d kHz, %.1f C%s",
+                         cpu->cpu_id, cpu->current_usage, cpu->predicted_load, cpu->active_tasks,
+                         cpu->capacity, cpu->cur_freq_khz, cpu->temperature,
+                         cpu->reserved ? ", reserved" : cpu->parked ? ", parked" : "");
     }
 }
 
 #include <stdlib.h>
 
-void cleanup_cpu_monitor(CPUMonitor* monitor) {
+void cpub_cleanup_cpu_monitor(CPUMonitor* monitor) {
     if (monitor == NULL) {
         return; // Nothing to clean up
     }
@@ -157,6 +603,8 @@ void cleanup_cpu_monitor(CPUMonitor* monitor) {
                 free(cpu->usage_history);
                 cpu->usage_history = NULL;
             }
+            free(cpu->temp_path);
+            cpu->temp_path = NULL;
         }
         
         // Free the stats array
@@ -164,11 +612,8 @@ void cleanup_cpu_monitor(CPUMonitor* monitor) {
         monitor->stats = NULL;
     }
 
-    // Free the configuration if allocated
-    if (monitor->config != NULL) {
-        free(monitor->config);
-        monitor->config = NULL;
-    }
+    // The configuration belongs to whoever created the monitor
+    monitor->config = NULL;
 
     // Reset the number of CPUs
     monitor->num_cpus = 0;
@@ -5,30 +5,106 @@
 #include <signal.h>
 #include <sched.h>
 #include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <float.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
 #include <bits/cpu-set.h>
 
-static pthread_mutex_t active_tasks_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t active_tasks_cond = PTHREAD_COND_INITIALIZER;
-static int total_active_tasks = 0;
+// Distinct task functions tracked for run-time estimates
+#define TASK_PROFILE_CAPACITY 256
+
+typedef struct {
+    LoadBalancer* lb;
+    int count;
+    Task* tasks[];
+} TaskBatch;
+
+static void build_pack_order(LoadBalancer* lb);
+static void update_placement_mode(LoadBalancer* lb);
+static void reserve_critical_lane(LoadBalancer* lb);
+static void start_critical_lane(LoadBalancer* lb);
+static void stop_critical_lane(LoadBalancer* lb);
+static void destroy_load_balancer(LoadBalancer* lb);
+static void wake_lane_worker(LoadBalancer* lb);
+static void drain_critical_ring(LoadBalancer* lb);
+static void charge_running_tasks(LoadBalancer* lb);
+static void* monitor_thread_func(void* arg);
+static void* scheduler_thread_func(void* arg);
+static void* timer_thread_func(void* arg);
 
 LoadBalancer* init_load_balancer(LoadBalancerConfig* config) {
     LoadBalancer* lb = malloc(sizeof(LoadBalancer));
     if (!lb) return NULL;
     
     lb->config = config;
-    lb->cpu_monitor = init_cpu_monitor(config);
-    lb->task_queue = init_task_queue(config->max_tasks);
-    fprintf(stdout, "%d", config->max_tasks);
-    fflush(stdout);
-    char x;
-    scanf("%c", &x);
+    lb->cpu_monitor = cpub_init_cpu_monitor(config);
+    lb->task_queue = cpub_init_task_queue(config->max_tasks, config->max_queue_capacity,
+                                          config->queue_policy);
+    lb->task_profile = cpub_init_task_profile(TASK_PROFILE_CAPACITY);
+    lb->timer_wheel = cpub_init_timer_wheel(config->timer_tick_ms);
+    lb->affinity_table = cpub_init_affinity_table(config->affinity_table_size);
+    memset(&lb->stats, 0, sizeof(LoadBalancerStats));
     lb->running = 0;
+    lb->total_active_tasks = 0;
+    lb->active_tasks = NULL;
+    lb->live_lane_workers = 0;
+    lb->cleanup_pending = 0;
+    lb->critical_ring = NULL;
+    lb->lane_workers = NULL;
+    lb->num_lane_workers = 0;
+    lb->lane_running = 0;
+    lb->lane_wake_seq = 0;
+    lb->lane_sleepers = 0;
+    lb->sample_requested = 0;
+    lb->dispatched_since_sample = 0;
+    lb->last_sample_ns = 0;
+    lb->pack_order = NULL;
+    lb->packing = config->placement_mode == PLACEMENT_PACK;
+    lb->monitor_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    lb->monitor_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    lb->monitor_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
     
-    if (!lb->cpu_monitor || !lb->task_queue) {
+    if (!lb->cpu_monitor || !lb->task_queue || !lb->task_profile || !lb->timer_wheel ||
+        !lb->affinity_table) {
+        return NULL;
+    }
+    if (lb->monitor_epoll_fd < 0 || lb->monitor_timer_fd < 0 || lb->monitor_wake_fd < 0) {
+        cpub_log_message(LOG_ERROR, "Failed to create monitor descriptors: %s", strerror(errno));
         return NULL;
     }
+    struct epoll_event event = {.events = EPOLLIN};
+    event.data.fd = lb->monitor_timer_fd;
+    epoll_ctl(lb->monitor_epoll_fd, EPOLL_CTL_ADD, lb->monitor_timer_fd, &event);
+    event.data.fd = lb->monitor_wake_fd;
+    epoll_ctl(lb->monitor_epoll_fd, EPOLL_CTL_ADD, lb->monitor_wake_fd, &event);
+    // Shares only decide anything while groups contend for a bounded number of
+    // running slots, so fair share defaults to one per CPU
+    int max_running = config->max_running_tasks;
+    if (config->enable_fair_share && max_running <= 0) {
+        max_running = lb->cpu_monitor->num_cpus;
+    }
+    cpub_set_queue_fair_share(lb->task_queue, config->enable_fair_share, config->default_group_weight,
+                              max_running);
+    
+    // Both condition variables are waited on with CLOCK_MONOTONIC deadlines
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&lb->timer_mutex, NULL);
+    pthread_cond_init(&lb->timer_cond, &attr);
+    pthread_mutex_init(&lb->active_tasks_mutex, NULL);
+    pthread_cond_init(&lb->active_tasks_cond, &attr);
+    pthread_condattr_destroy(&attr);
     
-    init_logger(config->log_file_path, config->enable_detailed_logging);
+    cpub_init_logger(config->log_file_path, config->enable_detailed_logging);
+    build_pack_order(lb);
+    reserve_critical_lane(lb);
     return lb;
 }
 
@@ -36,37 +112,200 @@ void start_load_balancer(LoadBalancer* lb) {
     lb->running = 1;
     pthread_create(&lb->monitor_thread, NULL, monitor_thread_func, lb);
     pthread_create(&lb->scheduler_thread, NULL, scheduler_thread_func, lb);
-    log_message(LOG_INFO, "Load balancer started");
+    pthread_create(&lb->timer_thread, NULL, timer_thread_func, lb);
+    start_critical_lane(lb);
+    cpub_log_message(LOG_INFO, "Load balancer started");
 }
 
-void* monitor_thread_func(void* arg) {
+static void add_timespec_ms(struct timespec* ts, long ms) {
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+// Drives the timer wheel; one thread serves every task timeout. With fair
+// share it also charges running tasks to their groups every tick.
+static void* timer_thread_func(void* arg) {
     LoadBalancer* lb = (LoadBalancer*)arg;
-    
+    struct timespec next_tick;
+    clock_gettime(CLOCK_MONOTONIC, &next_tick);
+
+    pthread_mutex_lock(&lb->timer_mutex);
     while (lb->running) {
-        update_cpu_stats(lb->cpu_monitor);
-        
-        if (lb->config->enable_detailed_logging) {
-            print_cpu_stats(lb->cpu_monitor);
+        add_timespec_ms(&next_tick, lb->timer_wheel->tick_ms);
+        pthread_cond_timedwait(&lb->timer_cond, &lb->timer_mutex, &next_tick);
+        if (!lb->running) break;
+
+        pthread_mutex_unlock(&lb->timer_mutex);
+        int expired = cpub_timer_wheel_advance(lb->timer_wheel);
+        if (expired > 0) {
+            __atomic_fetch_add(&lb->stats.tasks_timed_out, expired, __ATOMIC_RELAXED);
+        }
+        if (lb->config->enable_fair_share) {
+            charge_running_tasks(lb);
+        }
+        pthread_mutex_lock(&lb->timer_mutex);
+    }
+    pthread_mutex_unlock(&lb->timer_mutex);
+
+    return NULL;
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void arm_monitor_timer(LoadBalancer* lb, uint64_t delay_ns) {
+    struct itimerspec spec = {0};
+    if (delay_ns == 0) delay_ns = 1;  // a zero it_value would disarm the timer
+    spec.it_value.tv_sec = delay_ns / 1000000000ULL;
+    spec.it_value.tv_nsec = delay_ns % 1000000000ULL;
+    timerfd_settime(lb->monitor_timer_fd, 0, &spec, NULL);
+}
+
+static void update_max_ns(uint64_t* max, uint64_t value) {
+    uint64_t current = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > current &&
+           !__atomic_compare_exchange_n(max, &current, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Asks the monitor for a fresh sample ahead of its interval, e.g. after a burst
+// of dispatches. Requests made while one is pending are folded together.
+void request_cpu_sample(LoadBalancer* lb) {
+    if (__atomic_exchange_n(&lb->sample_requested, 1, __ATOMIC_RELAXED)) return;
+    uint64_t one = 1;
+    if (write(lb->monitor_wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        cpub_log_message(LOG_WARNING, "Failed to wake monitor: %s", strerror(errno));
+    }
+}
+
+// Samples on a timerfd whose interval doubles, up to max_monitoring_interval_ms,
+// while no CPU moves more than stable_load_delta and resets on any change. The
+// eventfd brings a sample forward (never closer than min_sample_gap_ms to the
+// previous one) or wakes the thread for shutdown.
+static void* monitor_thread_func(void* arg) {
+    LoadBalancer* lb = (LoadBalancer*)arg;
+    LoadBalancerConfig* config = lb->config;
+    CPUMonitor* monitor = lb->cpu_monitor;
+    int base_interval = config->monitoring_interval_ms > 0 ? config->monitoring_interval_ms : 1;
+    int max_interval = config->max_monitoring_interval_ms > base_interval ?
+                       config->max_monitoring_interval_ms : base_interval;
+    uint64_t min_gap_ns = (uint64_t)config->min_sample_gap_ms * 1000000ULL;
+    int interval = base_interval;
+    double* previous_usage = calloc(monitor->num_cpus, sizeof(double));
+    uint64_t last_sample = 0;
+
+    __atomic_store_n(&lb->stats.monitor_interval_ms, interval, __ATOMIC_RELAXED);
+    arm_monitor_timer(lb, 0);
+
+    while (lb->running) {
+        struct epoll_event events[2];
+        int ready = epoll_wait(lb->monitor_epoll_fd, events, 2, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            cpub_log_message(LOG_ERROR, "Monitor epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+        if (!lb->running) break;
+
+        uint64_t count;
+        int due = 0, requested = 0;
+        for (int i = 0; i < ready; i++) {
+            if (read(events[i].data.fd, &count, sizeof(count)) != sizeof(count)) continue;
+            if (events[i].data.fd == lb->monitor_timer_fd) due = 1;
+            else requested = 1;
+        }
+
+        uint64_t start = monotonic_ns();
+        if (!due) {
+            if (!requested) continue;
+            if (start - last_sample < min_gap_ns) {
+                // Too soon for /proc/stat to show a difference; pull the timer in
+                struct itimerspec pending;
+                uint64_t delay = min_gap_ns - (start - last_sample);
+                timerfd_gettime(lb->monitor_timer_fd, &pending);
+                uint64_t remaining = (uint64_t)pending.it_value.tv_sec * 1000000000ULL +
+                                     pending.it_value.tv_nsec;
+                if (remaining == 0 || delay < remaining) arm_monitor_timer(lb, delay);
+                continue;
+            }
         }
+        int early = __atomic_exchange_n(&lb->sample_requested, 0, __ATOMIC_RELAXED);
+        if (early) {
+            __atomic_fetch_add(&lb->stats.cpu_samples_requested, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&lb->dispatched_since_sample, 0, __ATOMIC_RELAXED);
+
+        for (int i = 0; previous_usage && i < monitor->num_cpus; i++) {
+            previous_usage[i] = monitor->stats[i].current_usage;
+        }
+        cpub_update_cpu_stats(monitor);
+        cpub_update_cpu_capacity(monitor);
+        if (config->enable_elastic_cpus) {
+            cpub_update_elastic_cpus(monitor);
+        }
+        update_placement_mode(lb);
         
-        usleep(lb->config->monitoring_interval_ms * 1000);
+        if (config->enable_detailed_logging) {
+            cpub_log_cpu_stats(monitor);
+        }
+
+        double max_delta = 0.0;
+        for (int i = 0; previous_usage && i < monitor->num_cpus; i++) {
+            double delta = monitor->stats[i].current_usage - previous_usage[i];
+            if (delta < 0) delta = -delta;
+            if (delta > max_delta) max_delta = delta;
+        }
+        if (early || !previous_usage || max_delta > config->stable_load_delta) {
+            interval = base_interval;
+        } else if (interval < max_interval) {
+            interval = interval * 2 < max_interval ? interval * 2 : max_interval;
+        }
+
+        uint64_t end = monotonic_ns();
+        if (last_sample > 0) {
+            update_max_ns(&lb->stats.sample_gap_max_ns, end - last_sample);
+        }
+        last_sample = end;
+        __atomic_store_n(&lb->last_sample_ns, end, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&lb->stats.cpu_samples, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&lb->stats.sample_overhead_total_ns, end - start, __ATOMIC_RELAXED);
+        update_max_ns(&lb->stats.sample_overhead_max_ns, end - start);
+        __atomic_store_n(&lb->stats.monitor_interval_ms, interval, __ATOMIC_RELAXED);
+
+        arm_monitor_timer(lb, (uint64_t)interval * 1000000ULL);
     }
-    
+
+    free(previous_usage);
     return NULL;
 }
 
-int find_best_cpu(CPUMonitor* monitor) {
+static double effective_cpu_load(CPUMonitor* monitor, int cpu_id) {
+    double effective_load = monitor->stats[cpu_id].current_usage;
+    
+    if (monitor->config->enable_load_prediction) {
+        effective_load = (effective_load + monitor->stats[cpu_id].predicted_load) / 2;
+    }
+    
+    // Consider active tasks in the decision
+    effective_load += (monitor->stats[cpu_id].active_tasks * 10);
+    // A slower or throttled core fills up proportionally sooner
+    return effective_load / monitor->stats[cpu_id].capacity;
+}
+
+static int find_best_cpu(CPUMonitor* monitor) {
     int best_cpu = -1;
-    double lowest_load = 999.9;    
+    double lowest_load = DBL_MAX;
     for (int i = 0; i < monitor->num_cpus; i++) {
-        double effective_load = monitor->stats[i].current_usage;
-        
-        if (monitor->config->enable_load_prediction) {
-            effective_load = (effective_load + monitor->stats[i].predicted_load) / 2;
-        }
-        
-        // Consider active tasks in the decision
-        effective_load += (monitor->stats[i].active_tasks * 10);
+        if (!cpub_cpu_available(monitor, i)) continue;
+
+        double effective_load = effective_cpu_load(monitor, i);
         
         if (effective_load < lowest_load) {
             lowest_load = effective_load;
@@ -77,196 +316,1034 @@ int find_best_cpu(CPUMonitor* monitor) {
     return best_cpu;
 }
 
-int submit_task(LoadBalancer* lb, void (*function)(void*), void* args, TaskPriority priority) {
-    Task* task = create_task(function, args, priority);
+// Least loaded available CPU in the given cache domain whose effective load is below limit
+static int find_domain_cpu(CPUMonitor* monitor, int level, int domain, double limit) {
+    int best_cpu = -1;
+    double lowest_load = limit;
+
+    if (domain < 0) return -1;
+    for (int i = 0; i < monitor->num_cpus; i++) {
+        CPUStats* cpu = &monitor->stats[i];
+        if (!cpub_cpu_available(monitor, i)) continue;
+        if ((level == 2 ? cpu->l2_domain : cpu->l3_domain) != domain) continue;
+
+        double effective_load = effective_cpu_load(monitor, i);
+        if (effective_load < lowest_load) {
+            lowest_load = effective_load;
+            best_cpu = i;
+        }
+    }
+
+    return best_cpu;
+}
+
+static void build_pack_order(LoadBalancer* lb) {
+    CPUMonitor* monitor = lb->cpu_monitor;
+    lb->pack_order = malloc(sizeof(int) * monitor->num_cpus);
+    if (!lb->pack_order) return;
+
+    // Insertion sort on (L3 domain, cpu id); a domain id is its lowest CPU
+    for (int i = 0; i < monitor->num_cpus; i++) {
+        int domain = monitor->stats[i].l3_domain >= 0 ? monitor->stats[i].l3_domain : i;
+        int j = i;
+        while (j > 0) {
+            int other = lb->pack_order[j - 1];
+            int other_domain = monitor->stats[other].l3_domain >= 0 ? monitor->stats[other].l3_domain : other;
+            if (other_domain <= domain) break;
+            lb->pack_order[j] = other;
+            j--;
+        }
+        lb->pack_order[j] = i;
+    }
+}
+
+// First available CPU in packing order still below pack_target_utilization;
+// once every CPU is at the target, falls back to the least loaded one
+static int find_pack_cpu(LoadBalancer* lb) {
+    CPUMonitor* monitor = lb->cpu_monitor;
+    if (!lb->pack_order) return find_best_cpu(monitor);
+
+    for (int i = 0; i < monitor->num_cpus; i++) {
+        int cpu_id = lb->pack_order[i];
+        if (!cpub_cpu_available(monitor, cpu_id)) continue;
+        if (effective_cpu_load(monitor, cpu_id) < monitor->config->pack_target_utilization) {
+            return cpu_id;
+        }
+    }
+    return find_best_cpu(monitor);
+}
+
+static int select_cpu(LoadBalancer* lb) {
+    if (__atomic_load_n(&lb->packing, __ATOMIC_RELAXED)) {
+        return find_pack_cpu(lb);
+    }
+    return find_best_cpu(lb->cpu_monitor);
+}
+
+// In PLACEMENT_AUTO, packs once mean usage of the available CPUs drops below
+// low_load_threshold and spreads again above high_load_threshold
+static void update_placement_mode(LoadBalancer* lb) {
+    CPUMonitor* monitor = lb->cpu_monitor;
+    if (lb->config->placement_mode != PLACEMENT_AUTO) return;
+
+    double usage = 0.0;
+    int active = 0;
+    for (int i = 0; i < monitor->num_cpus; i++) {
+        if (!cpub_cpu_available(monitor, i)) continue;
+        usage += monitor->stats[i].current_usage;
+        active++;
+    }
+    if (active == 0) return;
+    usage /= active;
+
+    int packing = __atomic_load_n(&lb->packing, __ATOMIC_RELAXED);
+    if (!packing && usage < lb->config->low_load_threshold) {
+        packing = 1;
+    } else if (packing && usage > lb->config->high_load_threshold) {
+        packing = 0;
+    } else {
+        return;
+    }
+
+    __atomic_store_n(&lb->packing, packing, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&lb->stats.placement_mode_switches, 1, __ATOMIC_RELAXED);
+    cpub_log_message(LOG_INFO, "Placement switched to %s at %.1f%% mean usage",
+                     packing ? "packing" : "spreading", usage);
+}
+
+// Keeps tasks with the same affinity key on a warm cache: the key's previous
+// CPU first, then an L2 and an L3 sibling, unless they are more than
+// affinity_load_margin busier than the CPU placement would pick for an untagged task
+static int place_task(LoadBalancer* lb, Task* task) {
+    CPUMonitor* monitor = lb->cpu_monitor;
+    int fallback = select_cpu(lb);
+    if (task->affinity_key == 0) {
+        return fallback;
+    }
+
+    int cpu_id = -1;
+    int previous = cpub_affinity_lookup(lb->affinity_table, task->affinity_key);
+    if (previous >= 0 && previous < monitor->num_cpus && cpub_cpu_available(monitor, previous)) {
+        double limit = (fallback >= 0 ? effective_cpu_load(monitor, fallback) : 0.0) +
+                       monitor->config->affinity_load_margin;
+        if (effective_cpu_load(monitor, previous) <= limit) {
+            cpu_id = previous;
+            __atomic_fetch_add(&lb->stats.affinity_hits, 1, __ATOMIC_RELAXED);
+        } else {
+            cpu_id = find_domain_cpu(monitor, 2, monitor->stats[previous].l2_domain, limit);
+            if (cpu_id < 0) {
+                cpu_id = find_domain_cpu(monitor, 3, monitor->stats[previous].l3_domain, limit);
+            }
+            if (cpu_id >= 0) {
+                __atomic_fetch_add(&lb->stats.affinity_sibling_hits, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    if (cpu_id < 0) {
+        cpu_id = fallback;
+        __atomic_fetch_add(&lb->stats.affinity_misses, 1, __ATOMIC_RELAXED);
+    }
+    if (cpu_id >= 0) {
+        cpub_affinity_update(lb->affinity_table, task->affinity_key, cpu_id);
+    }
+
+    return cpu_id;
+}
+
+// Registers a dispatched task so it can be cancelled until it finishes
+static void track_task_start(LoadBalancer* lb, Task* task) {
+    pthread_mutex_lock(&lb->active_tasks_mutex);
+    lb->total_active_tasks++;
+    task->active_prev = NULL;
+    task->active_next = lb->active_tasks;
+    if (lb->active_tasks) lb->active_tasks->active_prev = task;
+    lb->active_tasks = task;
+    pthread_mutex_unlock(&lb->active_tasks_mutex);
+}
+
+// Whoever releases the last reference after a deferred cleanup frees the balancer
+static void release_balancer_ref(LoadBalancer* lb, int* count) {
+    pthread_mutex_lock(&lb->active_tasks_mutex);
+    (*count)--;
+    if (lb->total_active_tasks == 0 && lb->live_lane_workers == 0) {
+        pthread_cond_broadcast(&lb->active_tasks_cond);
+    }
+    int destroy = lb->cleanup_pending && lb->total_active_tasks == 0 && lb->live_lane_workers == 0;
+    pthread_mutex_unlock(&lb->active_tasks_mutex);
+
+    if (destroy) {
+        destroy_load_balancer(lb);
+    }
+}
+
+// Must be the last use of lb by a task thread: it may free the balancer
+static void track_task_complete(LoadBalancer* lb, Task* task) {
+    pthread_mutex_lock(&lb->active_tasks_mutex);
+    if (task->active_prev) {
+        task->active_prev->active_next = task->active_next;
+    } else {
+        lb->active_tasks = task->active_next;
+    }
+    if (task->active_next) {
+        task->active_next->active_prev = task->active_prev;
+    }
+    pthread_mutex_unlock(&lb->active_tasks_mutex);
+
+    release_balancer_ref(lb, &lb->total_active_tasks);
+}
+
+static double elapsed_ms(const struct timespec* start, const struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) * 1000.0 +
+           (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Charges each running task's group for the wall time it has run so far;
+// completion settles the charge against the measured CPU time
+static void charge_running_tasks(LoadBalancer* lb) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    // Holding the list keeps every task in it alive
+    pthread_mutex_lock(&lb->active_tasks_mutex);
+    for (Task* task = lb->active_tasks; task; task = task->active_next) {
+        if (__atomic_load_n(&task->status, __ATOMIC_ACQUIRE) != STATUS_RUNNING) continue;
+        double ran_ms = elapsed_ms(&task->start_time, &now);
+        if (ran_ms > 0) {
+            cpub_charge_running_task(lb->task_queue, task, (uint64_t)(ran_ms * 1e6));
+        }
+    }
+    pthread_mutex_unlock(&lb->active_tasks_mutex);
+}
+
+// A task is short once its function has a learned run time below min_task_runtime_ms
+static int is_short_task(Task* task, void* ctx) {
+    LoadBalancer* lb = (LoadBalancer*)ctx;
+    double estimate = cpub_estimate_task_runtime(lb->task_profile, task->function);
+    return estimate >= 0 && estimate < lb->config->min_task_runtime_ms;
+}
+
+static void record_deadline_outcome(LoadBalancer* lb, Task* task) {
+    double lateness_ms = elapsed_ms(&task->deadline, &task->end_time);
+    if (lateness_ms <= 0) {
+        __atomic_fetch_add(&lb->stats.deadline_met, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    int bucket = 0;
+    while (bucket < LATENESS_BUCKETS - 1 && lateness_ms >= (double)(1 << bucket)) {
+        bucket++;
+    }
+    __atomic_fetch_add(&lb->stats.deadline_missed, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&lb->stats.lateness_histogram[bucket], 1, __ATOMIC_RELAXED);
+    cpub_log_message(LOG_WARNING, "Task %d missed its deadline by %.3f ms", task->task_id, lateness_ms);
+}
+
+// Predicts whether a task can finish before its deadline given the learned run
+// times of the tasks queued ahead of it and the least loaded CPU's predicted utilisation
+static int deadline_feasible(LoadBalancer* lb, Task* task) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    double min_load = 100.0;
+    for (int i = 0; i < lb->cpu_monitor->num_cpus; i++) {
+        double load = cpub_predict_cpu_load(&lb->cpu_monitor->stats[i]);
+        if (load < min_load) min_load = load;
+    }
+    if (min_load > 95.0) min_load = 95.0;
+    if (min_load < 0.0) min_load = 0.0;
+
+    // Work ahead of us is shared by all CPUs; a busy CPU stretches it further
+    double queued_ms = cpub_get_queued_work_ms(lb->task_queue) / lb->cpu_monitor->num_cpus;
+    double slowdown = 100.0 / (100.0 - min_load);
+    double finish_ms = (queued_ms + task->predicted_ms) * slowdown;
+
+    return finish_ms <= elapsed_ms(&now, &task->deadline);
+}
+
+// Drops the task from its CPU's active count and its group's concurrency slot
+static void finish_task_accounting(LoadBalancer* lb, Task* task) {
+    if (task->assigned_cpu >= 0) {
+        __atomic_fetch_sub(&lb->cpu_monitor->stats[task->assigned_cpu].active_tasks, 1, __ATOMIC_RELAXED);
+    }
+    cpub_complete_queued_task(lb->task_queue, task);
+    track_task_complete(lb, task);
+}
+
+// Runs a tracked task on the calling thread, feeds the profile and releases the task
+static void execute_task(LoadBalancer* lb, Task* task) {
+    if (task_cancel_reason(task) != CANCEL_NONE) {
+        // Cancelled while waiting in a batch
+        __atomic_fetch_add(&lb->stats.tasks_cancelled, 1, __ATOMIC_RELAXED);
+        finish_task_accounting(lb, task);
+        cpub_discard_task(task, STATUS_CANCELLED);
+        return;
+    }
+
+    struct timespec cpu_start, cpu_end;
+    clock_gettime(CLOCK_MONOTONIC, &task->start_time);
+    // Publishes start_time to charge_running_tasks
+    __atomic_store_n(&task->status, STATUS_RUNNING, __ATOMIC_RELEASE);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+    cpub_timer_wheel_add(lb->timer_wheel, task, task->timeout_ms);
+    // A task body may run a short subtask inline; the outer task is current again afterwards
+    Task* outer = current_task();
+    cpub_set_current_task(task);
+
+    task->function(task->args);
+
+    cpub_set_current_task(outer);
+    cpub_timer_wheel_remove(lb->timer_wheel, task);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+    clock_gettime(CLOCK_MONOTONIC, &task->end_time);
+    task->cpu_time_ns = (uint64_t)(elapsed_ms(&cpu_start, &cpu_end) * 1e6);
+    task->cpu_usage = elapsed_ms(&task->start_time, &task->end_time) / 1000.0;
+
+    CancelReason reason = task_cancel_reason(task);
+    if (reason == CANCEL_NONE) {
+        __atomic_store_n(&task->status, STATUS_COMPLETED, __ATOMIC_RELAXED);
+        cpub_record_task_runtime(lb->task_profile, task->function, task->cpu_usage * 1000.0);
+    } else {
+        // Timeouts are counted by the timer thread when they fire
+        __atomic_store_n(&task->status, STATUS_CANCELLED, __ATOMIC_RELAXED);
+        if (reason != CANCEL_TIMEOUT) {
+            __atomic_fetch_add(&lb->stats.tasks_cancelled, 1, __ATOMIC_RELAXED);
+        }
+    }
+    if (task->has_deadline) {
+        record_deadline_outcome(lb, task);
+    }
+
+    finish_task_accounting(lb, task);
+    cpub_free_task(task);
+}
+
+// Hands a task to the queue according to the overload policy.
+// timeout_ms < 0 follows the policy, 0 never waits, > 0 waits at most that long.
+static int queue_task(LoadBalancer* lb, Task* task, int timeout_ms) {
+    OverloadPolicy policy = lb->config->overload_policy;
+    int task_id = task->task_id;
+
+    if (policy == OVERLOAD_BLOCK && timeout_ms < 0) {
+        return cpub_enqueue_task(lb->task_queue, task);
+    }
+
+    Task* shed = NULL;
+    int result = cpub_try_enqueue_task(lb->task_queue, task,
+                                       policy == OVERLOAD_SHED_LOWEST ? &shed : NULL);
+    if (result != 0 && timeout_ms > 0) {
+        struct timespec abstime;
+        clock_gettime(CLOCK_MONOTONIC, &abstime);
+        abstime.tv_sec += timeout_ms / 1000;
+        abstime.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (abstime.tv_nsec >= 1000000000L) {
+            abstime.tv_sec++;
+            abstime.tv_nsec -= 1000000000L;
+        }
+        result = cpub_enqueue_task_timed(lb->task_queue, task, &abstime);
+    }
+
+    if (shed) {
+        __atomic_fetch_add(&lb->stats.shed_by_priority[shed->priority], 1, __ATOMIC_RELAXED);
+        cpub_log_message(LOG_WARNING, "Task %d (priority %d) shed for task %d",
+                         shed->task_id, shed->priority, task_id);
+        cpub_discard_task(shed, STATUS_FAILED);
+    }
+
+    if (result != 0) {
+        __atomic_fetch_add(&lb->stats.rejected_by_priority[task->priority], 1, __ATOMIC_RELAXED);
+        cpub_log_message(LOG_WARNING, "Task %d rejected: queue full", task_id);
+    }
+
+    return result;
+}
+
+static int submit_internal(LoadBalancer* lb, void (*function)(void*), void* args,
+                           TaskPriority priority, const TaskOptions* options, int timeout_ms) {
+    Task* task = cpub_create_task(function, args, priority);
     if (!task) return -1;
-    
-    int result = enqueue_task(lb->task_queue, task);
+
+    __atomic_fetch_add(&lb->stats.tasks_submitted, 1, __ATOMIC_RELAXED);
+    int task_id = task->task_id;
+
+    if (options) {
+        cpub_set_task_deadline(task, &options->deadline);
+        task->timeout_ms = options->timeout_ms > 0 ? options->timeout_ms : 0;
+        task->affinity_key = options->affinity_key;
+        task->group_id = options->group_id;
+        task->on_drop = options->on_drop;
+    }
+    // Unknown functions count as free until their first run is measured
+    double estimate = cpub_estimate_task_runtime(lb->task_profile, function);
+    task->predicted_ms = estimate > 0 ? estimate : 0.0;
+
+    if (task->has_deadline && !deadline_feasible(lb, task)) {
+        if (lb->config->deadline_admission == DEADLINE_ADMISSION_REJECT) {
+            __atomic_fetch_add(&lb->stats.deadline_rejected, 1, __ATOMIC_RELAXED);
+            cpub_log_message(LOG_WARNING, "Task %d rejected: deadline cannot be met", task_id);
+            cpub_free_task(task);
+            return -1;
+        }
+        // Under FIFO the queue dispatches flagged tasks ahead of on-time ones
+        task->deadline_at_risk = 1;
+        __atomic_fetch_add(&lb->stats.deadline_flagged, 1, __ATOMIC_RELAXED);
+        cpub_log_message(LOG_WARNING, "Task %d admitted but predicted to miss its deadline", task_id);
+    }
+
+    // Critical work bypasses the queue and scheduler when the lane is running
+    if (priority == PRIORITY_CRITICAL && __atomic_load_n(&lb->lane_running, __ATOMIC_ACQUIRE)) {
+        track_task_start(lb, task);
+        if (cpub_task_ring_push(lb->critical_ring, task) == 0) {
+            // Pairs with the fence in stop_critical_lane: if the lane stopped
+            // after our check, its drain may have missed this push, so whoever
+            // published last cancels what is left
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (!__atomic_load_n(&lb->lane_running, __ATOMIC_ACQUIRE)) {
+                drain_critical_ring(lb);
+            } else {
+                wake_lane_worker(lb);
+            }
+            return task_id;
+        }
+        // Ring full: fall back to the regular path
+        track_task_complete(lb, task);
+    }
+
+    // Short work is cheaper to run here than to queue behind a deep backlog
+    if (lb->config->inline_queue_depth > 0 && is_short_task(task, lb) &&
+        cpub_get_queue_size(lb->task_queue) >= lb->config->inline_queue_depth) {
+        track_task_start(lb, task);
+        __atomic_fetch_add(&lb->stats.tasks_inlined, 1, __ATOMIC_RELAXED);
+        execute_task(lb, task);
+        return task_id;
+    }
+
+    int result = queue_task(lb, task, timeout_ms);
     if (result != 0) {
-        free_task(task);
+        cpub_free_task(task);
         return -1;
     }
-    
-    return 0;
+
+    return task_id;
+}
+
+int submit_task(LoadBalancer* lb, void (*function)(void*), void* args, TaskPriority priority) {
+    return submit_internal(lb, function, args, priority, NULL, -1) < 0 ? -1 : 0;
 }
 
-static void track_task_start() {
-    pthread_mutex_lock(&active_tasks_mutex);
-    total_active_tasks++;
-    pthread_mutex_unlock(&active_tasks_mutex);
+// Returns the new task's id, or -1 if it was not accepted
+int submit_task_ex(LoadBalancer* lb, void (*function)(void*), void* args, TaskPriority priority,
+                   const TaskOptions* options) {
+    return submit_internal(lb, function, args, priority, options, -1);
 }
 
-static void track_task_complete() {
-    pthread_mutex_lock(&active_tasks_mutex);
-    total_active_tasks--;
-    if (total_active_tasks == 0) {
-        pthread_cond_broadcast(&active_tasks_cond);
-    }
-    pthread_mutex_unlock(&active_tasks_mutex);
+// Never blocks, whatever the overload policy; returns -1 when the queue is full
+int try_submit_task(LoadBalancer* lb, void (*function)(void*), void* args, TaskPriority priority) {
+    return submit_internal(lb, function, args, priority, NULL, 0) < 0 ? -1 : 0;
+}
+
+// Waits up to timeout_ms for room in the queue; returns -1 on timeout
+int submit_task_timed(LoadBalancer* lb, void (*function)(void*), void* args, TaskPriority priority,
+                      int timeout_ms) {
+    if (timeout_ms < 0) timeout_ms = 0;
+    return submit_internal(lb, function, args, priority, NULL, timeout_ms) < 0 ? -1 : 0;
+}
+
+// Producers get QUEUE_WATERMARK_HIGH when the queue fills past queue_high_watermark
+// and QUEUE_WATERMARK_LOW once it drains to queue_low_watermark
+void set_backpressure_callback(LoadBalancer* lb, QueueWatermarkCallback callback, void* ctx) {
+    cpub_set_queue_watermarks(lb->task_queue, lb->config->queue_high_watermark,
+                              lb->config->queue_low_watermark, callback, ctx);
 }
 
 // Wrapper for task execution
 static void* task_wrapper(void* arg) {
-    Task* task = (Task*)arg;
-    track_task_start();
-    
-    task->function(task->args);
-    
-    task->status = STATUS_COMPLETED;
-    clock_gettime(CLOCK_MONOTONIC, &task->end_time);
-    
-    // Update CPU stats
-    if (task->assigned_cpu >= 0) {
-        pthread_mutex_lock(&active_tasks_mutex);
-        task->cpu_usage = task->end_time.tv_sec - task->start_time.tv_sec +
-                         (task->end_time.tv_nsec - task->start_time.tv_nsec) / 1e9;
-        pthread_mutex_unlock(&active_tasks_mutex);
+    TaskBatch* batch = (TaskBatch*)arg;
+    LoadBalancer* lb = batch->lb;
+
+    // The balancer may be torn down once the last task completes; don't touch it after
+    for (int i = 0; i < batch->count; i++) {
+        execute_task(lb, batch->tasks[i]);
     }
-    
-    track_task_complete();
+
+    free(batch);
+    return NULL;
+}
+
+// A task that could not be dispatched never runs. It still holds the group and
+// queue slot it was dequeued with, which must be released or a capped group stalls.
+static void fail_task(LoadBalancer* lb, Task* task, const char* reason) {
+    cpub_log_message(LOG_ERROR, "Task %d failed: %s", task->task_id, reason);
+    cpub_release_queued_task(lb->task_queue, task);
+    __atomic_fetch_add(&lb->stats.tasks_failed, 1, __ATOMIC_RELAXED);
+    cpub_discard_task(task, STATUS_FAILED);
+}
+
+static void fail_batch(LoadBalancer* lb, TaskBatch* batch, const char* reason) {
+    for (int i = 0; i < batch->count; i++) {
+        fail_task(lb, batch->tasks[i], reason);
+    }
+    free(batch);
+}
+
+// Pins one thread to the best CPU and runs every task of the batch on it
+static void dispatch_batch(LoadBalancer* lb, TaskBatch* batch) {
+    int cpu_id = place_task(lb, batch->tasks[0]);
+    if (cpu_id < 0) {
+        fail_batch(lb, batch, "no CPU available");
+        return;
+    }
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu_id, &cpuset);
+
+    for (int i = 0; i < batch->count; i++) {
+        batch->tasks[i]->assigned_cpu = cpu_id;
+        track_task_start(lb, batch->tasks[i]);
+    }
+    __atomic_fetch_add(&lb->cpu_monitor->stats[cpu_id].active_tasks, batch->count, __ATOMIC_RELAXED);
+
+    int count = batch->count;
+
+    pthread_t thread;
+    int error = pthread_create(&thread, NULL, task_wrapper, batch);
+    if (error != 0) {
+        __atomic_fetch_sub(&lb->cpu_monitor->stats[cpu_id].active_tasks, count, __ATOMIC_RELAXED);
+        for (int i = 0; i < count; i++) {
+            track_task_complete(lb, batch->tasks[i]);
+        }
+        fail_batch(lb, batch, strerror(error));
+        return;
+    }
+    pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
+
+    // Detach the thread so we don't need to join it
+    pthread_detach(thread);
+
+    // Counted, not logged: a log line here would serialize every dispatch
+    // on the logger's mutex
+    if (count > 1) {
+        __atomic_fetch_add(&lb->stats.batches_dispatched, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&lb->stats.tasks_coalesced, count, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&lb->stats.tasks_dispatched, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static void record_critical_latency(LoadBalancer* lb, Task* task) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t latency_ns = (uint64_t)(now.tv_sec - task->create_time.tv_sec) * 1000000000ULL +
+                          (now.tv_nsec - task->create_time.tv_nsec);
+
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && latency_ns >= (1000ULL << bucket)) {
+        bucket++;
+    }
+
+    __atomic_fetch_add(&lb->stats.critical_lane_tasks, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&lb->stats.critical_latency_total_ns, latency_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&lb->stats.critical_latency_histogram[bucket], 1, __ATOMIC_RELAXED);
+
+    update_max_ns(&lb->stats.critical_latency_max_ns, latency_ns);
+}
+
+// Parks an idle lane worker on a futex until a push or stop_critical_lane wakes it
+static void park_lane_worker(LoadBalancer* lb) {
+    uint32_t seq = __atomic_load_n(&lb->lane_wake_seq, __ATOMIC_ACQUIRE);
+    __atomic_fetch_add(&lb->lane_sleepers, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (cpub_task_ring_empty(lb->critical_ring) && __atomic_load_n(&lb->lane_running, __ATOMIC_ACQUIRE)) {
+        syscall(SYS_futex, &lb->lane_wake_seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+    }
+    __atomic_fetch_sub(&lb->lane_sleepers, 1, __ATOMIC_RELAXED);
+}
+
+static void wake_lane_workers(LoadBalancer* lb, int count) {
+    __atomic_fetch_add(&lb->lane_wake_seq, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &lb->lane_wake_seq, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+// Called after a push. Pairs with the fence in park_lane_worker: either the
+// worker sees the task before sleeping or we see it parked.
+static void wake_lane_worker(LoadBalancer* lb) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&lb->lane_sleepers, __ATOMIC_RELAXED) > 0) {
+        wake_lane_workers(lb, 1);
+    }
+}
+
+// Busy-polls the critical ring from a reserved core. Spins with a pause hint
+// first, then yields, and parks on a futex once the lane has been idle for a
+// while, so a sporadic task pays one futex wake-up rather than a sleep interval.
+static void* critical_lane_worker(void* arg) {
+    LaneWorker* worker = (LaneWorker*)arg;
+    LoadBalancer* lb = worker->lb;
+    int spin_limit = lb->config->critical_spin_count;
+    int idle = 0;
+
+    while (__atomic_load_n(&lb->lane_running, __ATOMIC_ACQUIRE)) {
+        Task* task = cpub_task_ring_pop(lb->critical_ring);
+        if (task) {
+            idle = 0;
+            record_critical_latency(lb, task);
+            task->assigned_cpu = worker->cpu_id;
+            __atomic_fetch_add(&lb->cpu_monitor->stats[worker->cpu_id].active_tasks, 1, __ATOMIC_RELAXED);
+            execute_task(lb, task);
+            continue;
+        }
+
+        if (idle < spin_limit) {
+            cpu_relax();
+        } else if (idle < 2 * spin_limit) {
+            sched_yield();
+        } else {
+            park_lane_worker(lb);
+        }
+        if (idle < 2 * spin_limit) idle++;
+    }
+
+    release_balancer_ref(lb, &lb->live_lane_workers);
     return NULL;
 }
 
-void* scheduler_thread_func(void* arg) {
+static void reserve_critical_lane(LoadBalancer* lb) {
+    CPUMonitor* monitor = lb->cpu_monitor;
+    uint64_t mask = lb->config->critical_lane_cpu_mask;
+    int reserved = 0;
+
+    for (int i = 0; i < monitor->num_cpus && i < 64; i++) {
+        if (mask & (1ULL << i)) reserved++;
+    }
+    if (reserved == 0) return;
+    if (reserved >= monitor->num_cpus) {
+        cpub_log_message(LOG_ERROR, "Critical lane would reserve every CPU; lane disabled");
+        return;
+    }
+
+    lb->critical_ring = cpub_init_task_ring(lb->config->critical_ring_size);
+    lb->lane_workers = calloc(reserved, sizeof(LaneWorker));
+    if (!lb->critical_ring || !lb->lane_workers) {
+        cpub_log_message(LOG_ERROR, "Failed to allocate critical lane; lane disabled");
+        cpub_cleanup_task_ring(lb->critical_ring);
+        free(lb->lane_workers);
+        lb->critical_ring = NULL;
+        lb->lane_workers = NULL;
+        return;
+    }
+
+    for (int i = 0; i < monitor->num_cpus && i < 64; i++) {
+        if (mask & (1ULL << i)) {
+            monitor->stats[i].reserved = 1;
+            lb->lane_workers[lb->num_lane_workers].lb = lb;
+            lb->lane_workers[lb->num_lane_workers].cpu_id = i;
+            lb->num_lane_workers++;
+        }
+    }
+}
+
+static void start_critical_lane(LoadBalancer* lb) {
+    if (lb->num_lane_workers == 0) return;
+
+    int started = 0;
+    __atomic_store_n(&lb->lane_running, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < lb->num_lane_workers; i++) {
+        LaneWorker* worker = &lb->lane_workers[i];
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(worker->cpu_id, &cpuset);
+
+        // Workers are detached and counted instead of joined, so shutdown can
+        // give up on one stuck in a critical task
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpuset);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_mutex_lock(&lb->active_tasks_mutex);
+        lb->live_lane_workers++;
+        pthread_mutex_unlock(&lb->active_tasks_mutex);
+        int error = pthread_create(&worker->thread, &attr, critical_lane_worker, worker);
+        pthread_attr_destroy(&attr);
+
+        if (error == 0) {
+            started++;
+        } else {
+            pthread_mutex_lock(&lb->active_tasks_mutex);
+            lb->live_lane_workers--;
+            pthread_mutex_unlock(&lb->active_tasks_mutex);
+            // Give the core back to normal placement
+            cpub_log_message(LOG_ERROR, "Failed to start critical lane worker on CPU %d", worker->cpu_id);
+            lb->cpu_monitor->stats[worker->cpu_id].reserved = 0;
+        }
+    }
+
+    if (started == 0) {
+        __atomic_store_n(&lb->lane_running, 0, __ATOMIC_RELEASE);
+        return;
+    }
+    cpub_log_message(LOG_INFO, "Critical lane started on %d reserved CPUs", started);
+}
+
+// Cancels every task still in the critical ring. Pops are exclusive, so the
+// stopping thread and a late submitter may both drain without double frees.
+static void drain_critical_ring(LoadBalancer* lb) {
+    Task* task;
+    while ((task = cpub_task_ring_pop(lb->critical_ring)) != NULL) {
+        __atomic_fetch_add(&lb->stats.tasks_cancelled, 1, __ATOMIC_RELAXED);
+        track_task_complete(lb, task);
+        cpub_discard_task(task, STATUS_CANCELLED);
+    }
+}
+
+// Tells the lane workers to exit once their current task returns and cancels
+// whatever is still sitting in the ring. stop_load_balancer waits for the
+// workers within the shutdown grace period.
+static void stop_critical_lane(LoadBalancer* lb) {
+    if (!__atomic_load_n(&lb->lane_running, __ATOMIC_ACQUIRE)) return;
+
+    __atomic_store_n(&lb->lane_running, 0, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    wake_lane_workers(lb, INT_MAX);
+    drain_critical_ring(lb);
+}
+
+static void* scheduler_thread_func(void* arg) {
     LoadBalancer* lb = (LoadBalancer*)arg;
     sigset_t set;
-    
+    int max_batch = lb->config->coalesce_batch_size > 1 ? lb->config->coalesce_batch_size : 1;
+
     // Block SIGINT in this thread
     sigemptyset(&set);
     sigaddset(&set, SIGINT);
     pthread_sigmask(SIG_BLOCK, &set, NULL);
-    
+
     while (lb->running) {
-        Task* task = dequeue_task(lb->task_queue);
+        Task* task = cpub_dequeue_task(lb->task_queue);
         if (!task) continue;  // Queue might be empty after shutdown signal
-        
+
         if (!lb->running) {
             // If we're shutting down, mark task as failed and continue
-            task->status = STATUS_FAILED;
-            free_task(task);
+            cpub_discard_task(task, STATUS_FAILED);
             continue;
         }
-        
-        int cpu_id = find_best_cpu(lb->cpu_monitor);
-        if (cpu_id >= 0) {
-            cpu_set_t cpuset;
-            CPU_ZERO(&cpuset);
-            CPU_SET(cpu_id, &cpuset);
-            
-            task->assigned_cpu = cpu_id;
-            task->status = STATUS_RUNNING;
-            clock_gettime(CLOCK_MONOTONIC, &task->start_time);
-            
-            pthread_create(&task->thread, NULL, task_wrapper, task);
-            pthread_setaffinity_np(task->thread, sizeof(cpu_set_t), &cpuset);
-            
-            // Detach the thread so we don't need to join it
-            pthread_detach(task->thread);
-            
-            lb->cpu_monitor->stats[cpu_id].active_tasks++;
-            log_message(LOG_INFO, "Task %d assigned to CPU %d", task->task_id, cpu_id);
+
+        TaskBatch* batch = malloc(sizeof(TaskBatch) + sizeof(Task*) * max_batch);
+        if (!batch) {
+            fail_task(lb, task, "out of memory");
+            continue;
+        }
+        batch->lb = lb;
+        batch->tasks[0] = task;
+        batch->count = 1;
+
+        // Coalesce the run of short tasks waiting behind this one
+        if (max_batch > 1 && is_short_task(task, lb)) {
+            while (batch->count < max_batch) {
+                Task* next = cpub_dequeue_task_if(lb->task_queue, is_short_task, lb);
+                if (!next) break;
+                batch->tasks[batch->count++] = next;
+            }
+        }
+
+        // Once every CPU could have received new work the last sample is stale
+        int dispatched = batch->count;
+        dispatch_batch(lb, batch);
+        if (__atomic_add_fetch(&lb->dispatched_since_sample, dispatched, __ATOMIC_RELAXED) >=
+            lb->cpu_monitor->num_cpus) {
+            request_cpu_sample(lb);
         }
     }
-    
+
     return NULL;
 }
 
 void wait_for_tasks_completion(LoadBalancer* lb) {
-    pthread_mutex_lock(&active_tasks_mutex);
-    while (total_active_tasks > 0) {
-        pthread_cond_wait(&active_tasks_cond, &active_tasks_mutex);
+    pthread_mutex_lock(&lb->active_tasks_mutex);
+    while (lb->total_active_tasks > 0) {
+        pthread_cond_wait(&lb->active_tasks_cond, &lb->active_tasks_mutex);
     }
-    pthread_mutex_unlock(&active_tasks_mutex);
+    pthread_mutex_unlock(&lb->active_tasks_mutex);
 }
 
 void cancel_pending_tasks(LoadBalancer* lb) {
-    pthread_mutex_lock(&lb->task_queue->mutex);
-    log_message(LOG_INFO,"cancelling tasks started");
-    while (lb->task_queue->size > 0) {
-        Task* task = dequeue_task(lb->task_queue);
-        if (task) {
-            task->status = STATUS_FAILED;
-            free_task(task);
+    int cancelled = 0;
+    cpub_log_message(LOG_INFO,"cancelling tasks started");
+
+    Task* task;
+    while ((task = cpub_take_pending_task(lb->task_queue)) != NULL) {
+        cpub_discard_task(task, STATUS_CANCELLED);
+        cancelled++;
+    }
+
+    __atomic_fetch_add(&lb->stats.tasks_cancelled, cancelled, __ATOMIC_RELAXED);
+    cpub_log_message(LOG_INFO,"cancelling tasks completed %d", cancelled);
+}
+
+// Removes a queued task or asks a dispatched one to stop; returns -1 if unknown
+int cancel_task(LoadBalancer* lb, int task_id) {
+    Task* task = cpub_remove_task_by_id(lb->task_queue, task_id);
+    if (task) {
+        cpub_discard_task(task, STATUS_CANCELLED);
+        __atomic_fetch_add(&lb->stats.tasks_cancelled, 1, __ATOMIC_RELAXED);
+        cpub_log_message(LOG_INFO, "Task %d cancelled before dispatch", task_id);
+        return 0;
+    }
+
+    int found = 0;
+    pthread_mutex_lock(&lb->active_tasks_mutex);
+    for (task = lb->active_tasks; task; task = task->active_next) {
+        if (task->task_id == task_id) {
+            request_task_cancel(task, CANCEL_REQUESTED);
+            found = 1;
+            break;
         }
     }
-    pthread_mutex_unlock(&lb->task_queue->mutex);
-    log_message(LOG_INFO,"cancelling tasks completed %d", lb->task_queue->size);
+    pthread_mutex_unlock(&lb->active_tasks_mutex);
+
+    if (found) {
+        cpub_log_message(LOG_INFO, "Task %d asked to cancel", task_id);
+    }
+    return found ? 0 : -1;
 }
 
+// Stops the balancer threads and bounds the wait for running tasks to shutdown_grace_ms
 void stop_load_balancer(LoadBalancer* lb) {
     if (!lb) return;
     
-    log_message(LOG_INFO, "Initiating load balancer shutdown 1");
+    cpub_log_message(LOG_INFO, "Initiating load balancer shutdown");
     
-    // Set shutdown flag first
-    pthread_mutex_lock(&lb->task_queue->mutex);
+    // Closing the queue releases the scheduler and any blocked producers
     lb->running = 0;
-    pthread_mutex_unlock(&lb->task_queue->mutex);
-    
-    log_message(LOG_INFO, "Initiating load balancer shutdown 2");
-    
-    // Wake up ALL waiting threads with multiple broadcasts
-    for (int i = 0; i < 3; i++) {  // Try multiple times to ensure threads wake up
-        pthread_mutex_lock(&lb->task_queue->mutex);
-        pthread_cond_broadcast(&lb->task_queue->not_empty);
-        pthread_cond_broadcast(&lb->task_queue->not_full);
-        pthread_mutex_unlock(&lb->task_queue->mutex);
-        usleep(1000);  // Short sleep between attempts
-    }
-    
-    log_message(LOG_INFO, "Initiating load balancer shutdown 3");
-    
-    // Cancel pending tasks before joining threads
+    cpub_close_task_queue(lb->task_queue);
     cancel_pending_tasks(lb);
     
-    log_message(LOG_INFO, "Initiating load balancer shutdown 4");
-    
-    // Set a reasonable timeout for thread joining
-    struct timespec timeout;
-    clock_gettime(CLOCK_REALTIME, &timeout);
-    timeout.tv_sec += 5;  // 5 second timeout
-    
-    // Try to join monitor thread with timeout
-    int monitor_ret = pthread_timedjoin_np(lb->monitor_thread, NULL, &timeout);
-    if (monitor_ret != 0) {
-        log_message(LOG_WARNING, "Monitor thread join timed out, forcing cancellation");
-        pthread_cancel(lb->monitor_thread);
+    pthread_mutex_lock(&lb->timer_mutex);
+    pthread_cond_broadcast(&lb->timer_cond);
+    pthread_mutex_unlock(&lb->timer_mutex);
+    uint64_t one = 1;
+    if (write(lb->monitor_wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        cpub_log_message(LOG_WARNING, "Failed to wake monitor: %s", strerror(errno));
     }
     
-    log_message(LOG_INFO, "Initiating load balancer shutdown 5");
+    pthread_join(lb->scheduler_thread, NULL);
+    pthread_join(lb->timer_thread, NULL);
+    pthread_join(lb->monitor_thread, NULL);
     
-    // Update timeout for scheduler thread
-    clock_gettime(CLOCK_REALTIME, &timeout);
-    timeout.tv_sec += 5;
+    // Ask every dispatched task to stop and give them a bounded grace period
+    struct timespec grace;
+    clock_gettime(CLOCK_MONOTONIC, &grace);
+    add_timespec_ms(&grace, lb->config->shutdown_grace_ms);
     
-    // Try to join scheduler thread with timeout
-    int scheduler_ret = pthread_timedjoin_np(lb->scheduler_thread, NULL, &timeout);
-    if (scheduler_ret != 0) {
-        log_message(LOG_WARNING, "Scheduler thread join timed out, forcing cancellation");
-        pthread_cancel(lb->scheduler_thread);
+    pthread_mutex_lock(&lb->active_tasks_mutex);
+    for (Task* task = lb->active_tasks; task; task = task->active_next) {
+        request_task_cancel(task, CANCEL_SHUTDOWN);
     }
+    pthread_mutex_unlock(&lb->active_tasks_mutex);
     
-    log_message(LOG_INFO, "Initiating load balancer shutdown 6");
-    
-    // Set another timeout for remaining tasks
-    struct timespec wait_start, wait_current;
-    clock_gettime(CLOCK_REALTIME, &wait_start);
+    stop_critical_lane(lb);
     
-    // Wait for tasks with timeout
-    while (1) {
-        pthread_mutex_lock(&lb->task_queue->mutex);
-        int active_tasks = total_active_tasks;
-        pthread_mutex_unlock(&lb->task_queue->mutex);
-
-        if (active_tasks == 0) break;
-        
-        clock_gettime(CLOCK_REALTIME, &wait_current);
-        if (wait_current.tv_sec - wait_start.tv_sec > 5) {  // 5 second timeout
-            log_message(LOG_WARNING, "Task completion timed out, forcing shutdown");
+    pthread_mutex_lock(&lb->active_tasks_mutex);
+    while (lb->total_active_tasks > 0 || lb->live_lane_workers > 0) {
+        if (pthread_cond_timedwait(&lb->active_tasks_cond, &lb->active_tasks_mutex, &grace) == ETIMEDOUT) {
+            cpub_log_message(LOG_WARNING, "%d tasks still running after %d ms grace period",
+                             lb->total_active_tasks, lb->config->shutdown_grace_ms);
             break;
         }
-        usleep(100000);  // 100ms sleep between checks
     }
+    pthread_mutex_unlock(&lb->active_tasks_mutex);
     
-    log_message(LOG_INFO, "Load balancer stopped successfully");
+    log_load_balancer_stats(lb);
+    cpub_log_message(LOG_INFO, "Load balancer stopped successfully");
+}
+
+// Releases everything owned by the balancer; the config stays with the caller.
+// Tasks that outlived the shutdown grace period still use the balancer, so
+// then the last of them frees it when it returns.
+void cleanup_load_balancer(LoadBalancer* lb) {
+    if (!lb) return;
+
+    pthread_mutex_lock(&lb->active_tasks_mutex);
+    if (lb->total_active_tasks > 0 || lb->live_lane_workers > 0) {
+        lb->cleanup_pending = 1;
+        cpub_log_message(LOG_WARNING, "Cleanup deferred until %d running tasks return",
+                         lb->total_active_tasks);
+        pthread_mutex_unlock(&lb->active_tasks_mutex);
+        return;
+    }
+    pthread_mutex_unlock(&lb->active_tasks_mutex);
+
+    destroy_load_balancer(lb);
+}
+
+static void destroy_load_balancer(LoadBalancer* lb) {
+    cpub_cleanup_task_queue(lb->task_queue);
+    free(lb->task_queue);
+    cpub_cleanup_cpu_monitor(lb->cpu_monitor);
+    free(lb->cpu_monitor);
+    cpub_cleanup_task_profile(lb->task_profile);
+    cpub_cleanup_timer_wheel(lb->timer_wheel);
+    cpub_cleanup_task_ring(lb->critical_ring);
+    cpub_cleanup_affinity_table(lb->affinity_table);
+    free(lb->lane_workers);
+    free(lb->pack_order);
+    close(lb->monitor_epoll_fd);
+    close(lb->monitor_timer_fd);
+    close(lb->monitor_wake_fd);
+
+    pthread_mutex_destroy(&lb->timer_mutex);
+    pthread_cond_destroy(&lb->timer_cond);
+    pthread_mutex_destroy(&lb->active_tasks_mutex);
+    pthread_cond_destroy(&lb->active_tasks_cond);
+
+    cpub_cleanup_logger();
+    free(lb);
+}
+
+// Weight is relative to GROUP_WEIGHT_UNIT; max_concurrency 0 leaves the group uncapped
+int set_group_share(LoadBalancer* lb, int group_id, int weight, int max_concurrency) {
+    return cpub_set_task_group_share(lb->task_queue, group_id, weight, max_concurrency);
+}
+
+int get_group_stats(LoadBalancer* lb, TaskGroupStats* stats, int max_groups) {
+    return cpub_get_task_group_stats(lb->task_queue, stats, max_groups);
+}
+
+void get_load_balancer_stats(LoadBalancer* lb, LoadBalancerStats* stats) {
+    stats->tasks_submitted = __atomic_load_n(&lb->stats.tasks_submitted, __ATOMIC_RELAXED);
+    stats->tasks_dispatched = __atomic_load_n(&lb->stats.tasks_dispatched, __ATOMIC_RELAXED);
+    stats->tasks_coalesced = __atomic_load_n(&lb->stats.tasks_coalesced, __ATOMIC_RELAXED);
+    stats->batches_dispatched = __atomic_load_n(&lb->stats.batches_dispatched, __ATOMIC_RELAXED);
+    stats->tasks_inlined = __atomic_load_n(&lb->stats.tasks_inlined, __ATOMIC_RELAXED);
+    stats->tasks_failed = __atomic_load_n(&lb->stats.tasks_failed, __ATOMIC_RELAXED);
+    stats->deadline_met = __atomic_load_n(&lb->stats.deadline_met, __ATOMIC_RELAXED);
+    stats->deadline_missed = __atomic_load_n(&lb->stats.deadline_missed, __ATOMIC_RELAXED);
+    stats->deadline_rejected = __atomic_load_n(&lb->stats.deadline_rejected, __ATOMIC_RELAXED);
+    stats->deadline_flagged = __atomic_load_n(&lb->stats.deadline_flagged, __ATOMIC_RELAXED);
+    for (int i = 0; i < LATENESS_BUCKETS; i++) {
+        stats->lateness_histogram[i] = __atomic_load_n(&lb->stats.lateness_histogram[i], __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < NUM_PRIORITIES; i++) {
+        stats->rejected_by_priority[i] = __atomic_load_n(&lb->stats.rejected_by_priority[i], __ATOMIC_RELAXED);
+        stats->shed_by_priority[i] = __atomic_load_n(&lb->stats.shed_by_priority[i], __ATOMIC_RELAXED);
+    }
+    stats->tasks_cancelled = __atomic_load_n(&lb->stats.tasks_cancelled, __ATOMIC_RELAXED);
+    stats->tasks_timed_out = __atomic_load_n(&lb->stats.tasks_timed_out, __ATOMIC_RELAXED);
+    stats->critical_lane_tasks = __atomic_load_n(&lb->stats.critical_lane_tasks, __ATOMIC_RELAXED);
+    stats->critical_latency_total_ns = __atomic_load_n(&lb->stats.critical_latency_total_ns, __ATOMIC_RELAXED);
+    stats->critical_latency_max_ns = __atomic_load_n(&lb->stats.critical_latency_max_ns, __ATOMIC_RELAXED);
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        stats->critical_latency_histogram[i] = __atomic_load_n(&lb->stats.critical_latency_histogram[i], __ATOMIC_RELAXED);
+    }
+    stats->affinity_hits = __atomic_load_n(&lb->stats.affinity_hits, __ATOMIC_RELAXED);
+    stats->affinity_sibling_hits = __atomic_load_n(&lb->stats.affinity_sibling_hits, __ATOMIC_RELAXED);
+    stats->affinity_misses = __atomic_load_n(&lb->stats.affinity_misses, __ATOMIC_RELAXED);
+    stats->cpus_active = cpub_count_active_cpus(lb->cpu_monitor);
+    stats->cpus_parked = __atomic_load_n(&lb->cpu_monitor->cpus_parked, __ATOMIC_RELAXED);
+    stats->cpus_unparked = __atomic_load_n(&lb->cpu_monitor->cpus_unparked, __ATOMIC_RELAXED);
+    stats->cpu_samples = __atomic_load_n(&lb->stats.cpu_samples, __ATOMIC_RELAXED);
+    stats->cpu_samples_requested = __atomic_load_n(&lb->stats.cpu_samples_requested, __ATOMIC_RELAXED);
+    stats->sample_overhead_total_ns = __atomic_load_n(&lb->stats.sample_overhead_total_ns, __ATOMIC_RELAXED);
+    stats->sample_overhead_max_ns = __atomic_load_n(&lb->stats.sample_overhead_max_ns, __ATOMIC_RELAXED);
+    stats->sample_gap_max_ns = __atomic_load_n(&lb->stats.sample_gap_max_ns, __ATOMIC_RELAXED);
+    uint64_t last_sample = __atomic_load_n(&lb->last_sample_ns, __ATOMIC_RELAXED);
+    stats->sample_age_ns = last_sample ? monotonic_ns() - last_sample : 0;
+    stats->monitor_interval_ms = __atomic_load_n(&lb->stats.monitor_interval_ms, __ATOMIC_RELAXED);
+    stats->packing = __atomic_load_n(&lb->packing, __ATOMIC_RELAXED);
+    stats->placement_mode_switches = __atomic_load_n(&lb->stats.placement_mode_switches, __ATOMIC_RELAXED);
+}
+
+void log_load_balancer_stats(LoadBalancer* lb) {
+    LoadBalancerStats stats;
+    get_load_balancer_stats(lb, &stats);
+
+    cpub_log_message(LOG_INFO, "Tasks submitted: %lu, dispatched: %lu, coalesced: %lu in %lu batches, inlined: %lu",
+                     stats.tasks_submitted, stats.tasks_dispatched, stats.tasks_coalesced,
+                     stats.batches_dispatched, stats.tasks_inlined);
+    cpub_log_message(LOG_INFO, "Tasks cancelled: %lu, timed out: %lu, failed: %lu",
+                     stats.tasks_cancelled, stats.tasks_timed_out, stats.tasks_failed);
+    cpub_log_message(LOG_INFO, "Deadlines met: %lu, missed: %lu, rejected: %lu, flagged: %lu",
+                     stats.deadline_met, stats.deadline_missed,
+                     stats.deadline_rejected, stats.deadline_flagged);
+
+    for (int i = 0; i < LATENESS_BUCKETS; i++) {
+        if (stats.lateness_histogram[i] == 0) continue;
+        if (i == LATENESS_BUCKETS - 1) {
+            cpub_log_message(LOG_INFO, "  Lateness >= %d ms: %lu", 1 << (i - 1), stats.lateness_histogram[i]);
+        } else {
+            cpub_log_message(LOG_INFO, "  Lateness [%d, %d) ms: %lu", i ? 1 << (i - 1) : 0, 1 << i,
+                             stats.lateness_histogram[i]);
+        }
+    }
+
+    uint64_t keyed = stats.affinity_hits + stats.affinity_sibling_hits + stats.affinity_misses;
+    if (keyed > 0) {
+        cpub_log_message(LOG_INFO, "Affinity placements: %lu, same CPU %.1f%%, cache sibling %.1f%%, miss %.1f%%",
+                         keyed, 100.0 * stats.affinity_hits / keyed,
+                         100.0 * stats.affinity_sibling_hits / keyed,
+                         100.0 * stats.affinity_misses / keyed);
+    }
+
+    if (stats.critical_lane_tasks > 0) {
+        cpub_log_message(LOG_INFO, "Critical lane tasks: %lu, submit-to-start avg %.2f us, max %.2f us",
+                         stats.critical_lane_tasks,
+                         stats.critical_latency_total_ns / 1000.0 / stats.critical_lane_tasks,
+                         stats.critical_latency_max_ns / 1000.0);
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            if (stats.critical_latency_histogram[i] == 0) continue;
+            if (i == LATENCY_BUCKETS - 1) {
+                cpub_log_message(LOG_INFO, "  Latency >= %d us: %lu", 1 << (i - 1),
+                                 stats.critical_latency_histogram[i]);
+            } else {
+                cpub_log_message(LOG_INFO, "  Latency [%d, %d) us: %lu", i ? 1 << (i - 1) : 0, 1 << i,
+                                 stats.critical_latency_histogram[i]);
+            }
+        }
+    }
+
+    if (stats.cpu_samples > 0) {
+        cpub_log_message(LOG_INFO, "CPU samples: %lu (%lu requested), overhead avg %.1f us max %.1f us, "
+                         "longest gap %.1f ms, interval now %d ms",
+                         stats.cpu_samples, stats.cpu_samples_requested,
+                         stats.sample_overhead_total_ns / 1000.0 / stats.cpu_samples,
+                         stats.sample_overhead_max_ns / 1000.0, stats.sample_gap_max_ns / 1e6,
+                         stats.monitor_interval_ms);
+    }
+
+    if (lb->config->placement_mode == PLACEMENT_AUTO) {
+        cpub_log_message(LOG_INFO, "Placement: %s, %lu mode switches",
+                         stats.packing ? "packing" : "spreading", stats.placement_mode_switches);
+    }
+
+    if (lb->config->enable_elastic_cpus) {
+        cpub_log_message(LOG_INFO, "Elastic CPUs: %d active, parked %lu times, unparked %lu times",
+                         stats.cpus_active, stats.cpus_parked, stats.cpus_unparked);
+    }
+
+    for (int i = 0; i < NUM_PRIORITIES; i++) {
+        if (stats.rejected_by_priority[i] == 0 && stats.shed_by_priority[i] == 0) continue;
+        cpub_log_message(LOG_INFO, "Priority %d: rejected %lu, shed %lu",
+                         i, stats.rejected_by_priority[i], stats.shed_by_priority[i]);
+    }
+
+    if (lb->config->enable_fair_share) {
+        TaskGroupStats groups[64];
+        int count = get_group_stats(lb, groups, 64);
+        for (int i = 0; i < count; i++) {
+            TaskGroupStats* group = &groups[i];
+            cpub_log_message(LOG_INFO, "Group %d (weight %d): %lu tasks, CPU %.3f s, wait avg %.3f ms max %.3f ms",
+                             group->group_id, group->weight, group->tasks_run, group->usage_ns / 1e9,
+                             group->tasks_run ? group->total_wait_ns / 1e6 / group->tasks_run : 0.0,
+                             group->max_wait_ns / 1e6);
+        }
+    }
 }
\ No newline at end of file
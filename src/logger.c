@@ -4,19 +4,41 @@
 #include <pthread.h>
 #include <string.h>
 
+// One sink per process, shared by every balancer in it. Each cpub_init_logger
+// takes a reference and each cpub_cleanup_logger drops one; the file closes with
+// the last. The first caller's path is used until then.
 static FILE* log_file = NULL;
+static int logger_refs = 0;
 static int detailed_logging = 0;
+// Messages below this level return before taking the mutex
+static LogLevel min_level = LOG_ERROR + 1;
 static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-void init_logger(const char* file_path, int detailed) {
-    log_file = fopen(file_path, "a");
-    detailed_logging = detailed;
+static void set_min_level(void) {
+    LogLevel level = LOG_ERROR + 1;
+    if (log_file) level = detailed_logging ? LOG_DEBUG : LOG_INFO;
+    __atomic_store_n(&min_level, level, __ATOMIC_RELAXED);
 }
 
-void log_message(LogLevel level, const char* format, ...) {
-    if (!log_file) return;
+void cpub_init_logger(const char* file_path, int detailed) {
+    pthread_mutex_lock(&log_mutex);
+    if (logger_refs++ == 0) {
+        log_file = fopen(file_path, "a");
+    }
+    // DEBUG output is on while any balancer asked for it
+    detailed_logging |= detailed;
+    set_min_level();
+    pthread_mutex_unlock(&log_mutex);
+}
+
+void cpub_log_message(LogLevel level, const char* format, ...) {
+    if (level < __atomic_load_n(&min_level, __ATOMIC_RELAXED)) return;
     
     pthread_mutex_lock(&log_mutex);
+    if (!log_file) {
+        pthread_mutex_unlock(&log_mutex);
+        return;
+    }
     
     time_t now;
     time(&now);
@@ -45,9 +67,15 @@ void log_message(LogLevel level, const char* format, ...) {
     pthread_mutex_unlock(&log_mutex);
 }
 
-void cleanup_logger(void) {
-    if (log_file) {
-        fclose(log_file);
-        log_file = NULL;
+void cpub_cleanup_logger(void) {
+    pthread_mutex_lock(&log_mutex);
+    if (logger_refs > 0 && --logger_refs == 0) {
+        if (log_file) {
+            fclose(log_file);
+            log_file = NULL;
+        }
+        detailed_logging = 0;
+        set_min_level();
     }
-}
\ No newline at end of file
+    pthread_mutex_unlock(&log_mutex);
+}
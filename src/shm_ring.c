@@ -0,0 +1,212 @@
+#include "shm_ring.h"
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// Shared (not FUTEX_PRIVATE) operations: waiters and wakers live in different processes
+static void futex_wait(uint32_t* word, uint32_t expected, int timeout_ms) {
+    struct timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    syscall(SYS_futex, word, FUTEX_WAIT, expected, timeout_ms >= 0 ? &timeout : NULL, NULL, 0);
+}
+
+static void futex_wake(uint32_t* word, int count) {
+    syscall(SYS_futex, word, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+size_t cpub_shm_ring_bytes(uint32_t capacity) {
+    return sizeof(ShmRing) + sizeof(ShmRingSlot) * (size_t)capacity;
+}
+
+// Capacity must be a power of two of at least SHM_RING_MIN_CAPACITY; the
+// mapping must be cpub_shm_ring_bytes() long
+void cpub_shm_ring_format(ShmRing* ring, uint32_t capacity) {
+    memset(ring, 0, sizeof(ShmRing));
+    ring->version = SHM_RING_VERSION;
+    ring->capacity = capacity;
+    ring->slot_size = sizeof(ShmRingSlot);
+    for (uint32_t i = 0; i < capacity; i++) {
+        ring->slots[i].sequence = i;
+    }
+    __atomic_store_n(&ring->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+}
+
+// Reads the capacity once and checks that copy, so a peer rewriting the
+// header can't make *capacity disagree with what was validated
+int cpub_shm_ring_valid(const ShmRing* ring, size_t mapped_size, uint32_t* capacity) {
+    if (mapped_size < sizeof(ShmRing)) return 0;
+    if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC) return 0;
+    if (ring->version != SHM_RING_VERSION || ring->slot_size != sizeof(ShmRingSlot)) return 0;
+
+    uint32_t slots = __atomic_load_n(&ring->capacity, __ATOMIC_RELAXED);
+    if (slots < SHM_RING_MIN_CAPACITY || (slots & (slots - 1)) != 0) return 0;
+    if (cpub_shm_ring_bytes(slots) > mapped_size) return 0;
+    *capacity = slots;
+    return 1;
+}
+
+static int ring_empty(ShmRing* ring, uint32_t capacity) {
+    uint64_t pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    ShmRingSlot* slot = &ring->slots[pos & (capacity - 1)];
+    return __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos + 1;
+}
+
+static int ring_full(ShmRing* ring, uint32_t capacity) {
+    uint64_t pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    ShmRingSlot* slot = &ring->slots[pos & (capacity - 1)];
+    return (int64_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - pos) < 0;
+}
+
+// Returns -1 when the ring is full. capacity is the caller's validated copy.
+int cpub_shm_ring_push(ShmRing* ring, uint32_t capacity, const WorkDescriptor* work) {
+    uint64_t mask = capacity - 1;
+    uint64_t pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+
+    for (;;) {
+        ShmRingSlot* slot = &ring->slots[pos & mask];
+        uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)sequence - (int64_t)pos;
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                // Either CAS fails only if the consumer skipped the slot
+                // while we were descheduled; the work was never seen, so it
+                // goes into a fresh slot
+                uint64_t expected = pos;
+                if (__atomic_compare_exchange_n(&slot->sequence, &expected, pos + 2, 0,
+                                                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                    slot->work = *work;
+                    expected = pos + 2;
+                    if (__atomic_compare_exchange_n(&slot->sequence, &expected, pos + 1, 0,
+                                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                        break;
+                    }
+                }
+                pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    // Pairs with the fence in cpub_shm_ring_wait_work: either the consumer sees
+    // this slot before sleeping or we see it waiting
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->consumer_waiting, __ATOMIC_RELAXED)) {
+        cpub_shm_ring_wake_consumer(ring);
+    }
+    return 0;
+}
+
+// Moves the consumer past pos once its slot has been handed back
+static void advance_head(ShmRing* ring, uint64_t pos) {
+    __atomic_store_n(&ring->dequeue_pos, pos + 1, __ATOMIC_RELAXED);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->producers_waiting, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&ring->space_seq, 1, __ATOMIC_RELEASE);
+        futex_wake(&ring->space_seq, INT_MAX);
+    }
+}
+
+// What the slot at the consumer's position holds
+static int head_state(ShmRing* ring, ShmRingSlot* slot, uint64_t pos, uint64_t* sequence) {
+    *sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if (*sequence == pos + 1) return 0;
+    if (*sequence == pos + 2) return SHM_RING_WRITING;
+    if (*sequence == pos &&
+        (int64_t)(__atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED) - pos) > 0) {
+        return SHM_RING_CLAIMED;
+    }
+    return SHM_RING_EMPTY;
+}
+
+// Single consumer; returns 0 with *work filled, SHM_RING_EMPTY, or
+// SHM_RING_CLAIMED / SHM_RING_WRITING while a producer holds the next slot
+int cpub_shm_ring_pop(ShmRing* ring, uint32_t capacity, WorkDescriptor* work) {
+    uint64_t pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    ShmRingSlot* slot = &ring->slots[pos & (capacity - 1)];
+    uint64_t sequence;
+
+    int state = head_state(ring, slot, pos, &sequence);
+    if (state != 0) return state;
+    *work = slot->work;
+    __atomic_store_n(&slot->sequence, pos + capacity, __ATOMIC_RELEASE);
+    advance_head(ring, pos);
+    return 0;
+}
+
+// Single consumer; gives up on a next slot that a producer claimed but hasn't
+// published. Returns -1 if the slot was published or is empty after all.
+int cpub_shm_ring_skip(ShmRing* ring, uint32_t capacity) {
+    uint64_t pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    ShmRingSlot* slot = &ring->slots[pos & (capacity - 1)];
+    uint64_t sequence;
+
+    int state = head_state(ring, slot, pos, &sequence);
+    if (state != SHM_RING_CLAIMED && state != SHM_RING_WRITING) return -1;
+    if (!__atomic_compare_exchange_n(&slot->sequence, &sequence, pos + capacity, 0,
+                                     __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        return -1;
+    }
+    advance_head(ring, pos);
+    return 0;
+}
+
+// Position of the next slot the consumer will take
+uint64_t cpub_shm_ring_head(ShmRing* ring) {
+    return __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+}
+
+// Sleeps until a push, a wake-up or timeout_ms (negative waits indefinitely)
+void cpub_shm_ring_wait_work(ShmRing* ring, uint32_t capacity, int timeout_ms) {
+    uint32_t seq = __atomic_load_n(&ring->work_seq, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&ring->consumer_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (ring_empty(ring, capacity)) {
+        futex_wait(&ring->work_seq, seq, timeout_ms);
+    }
+    __atomic_store_n(&ring->consumer_waiting, 0, __ATOMIC_RELAXED);
+}
+
+// Sleeps until a pop frees a slot or timeout_ms (negative waits indefinitely)
+void cpub_shm_ring_wait_space(ShmRing* ring, uint32_t capacity, int timeout_ms) {
+    uint32_t seq = __atomic_load_n(&ring->space_seq, __ATOMIC_ACQUIRE);
+    __atomic_fetch_add(&ring->producers_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (ring_full(ring, capacity)) {
+        futex_wait(&ring->space_seq, seq, timeout_ms);
+    }
+    __atomic_fetch_sub(&ring->producers_waiting, 1, __ATOMIC_RELAXED);
+}
+
+void cpub_shm_ring_wake_consumer(ShmRing* ring) {
+    __atomic_fetch_add(&ring->work_seq, 1, __ATOMIC_RELEASE);
+    futex_wake(&ring->work_seq, 1);
+}
+
+// Fills a zeroed descriptor; returns -1 with errno EINVAL if the payload does not fit
+int prepare_work(WorkDescriptor* work, uint32_t opcode, uint32_t priority,
+                 const void* payload, size_t payload_size) {
+    if (payload_size > WORK_PAYLOAD_SIZE || (payload_size > 0 && !payload)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(work, 0, offsetof(WorkDescriptor, payload));
+    work->opcode = opcode;
+    work->priority = priority;
+    work->payload_size = (uint32_t)payload_size;
+    if (payload_size > 0) {
+        memcpy(work->payload, payload, payload_size);
+    }
+    return 0;
+}
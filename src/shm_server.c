@@ -0,0 +1,258 @@
+#include "shm_server.h"
+#include "logger.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// How long the drain thread sleeps before rechecking its running flag
+#define SHM_SERVER_POLL_MS 100
+// How long the next slot may stay claimed, or mid-copy, before its producer
+// is presumed dead and the slot is skipped. A live producer that loses the
+// slot this way pushes its work again.
+#define SHM_CLAIM_TIMEOUT_MS 100
+#define SHM_WRITE_TIMEOUT_MS 1000
+
+typedef struct {
+    WorkHandler handler;
+    WorkDescriptor work;
+} ShmWork;
+
+// One daemon per ring. The ring's companion lock object is never unlinked, so
+// an flock on it tells a live owner from a ring left behind by a crash.
+static int lock_ring_name(const char* name) {
+    char lock_name[256];
+    if (snprintf(lock_name, sizeof(lock_name), "%s.lock", name) >= (int)sizeof(lock_name)) {
+        cpub_log_message(LOG_ERROR, "Work ring name %s is too long", name);
+        return -1;
+    }
+
+    int fd = shm_open(lock_name, O_CREAT | O_RDWR, 0660);
+    if (fd < 0) {
+        cpub_log_message(LOG_ERROR, "Failed to open %s: %s", lock_name, strerror(errno));
+        return -1;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        if (errno == EWOULDBLOCK) {
+            cpub_log_message(LOG_ERROR, "Work ring %s is served by another running daemon", name);
+        } else {
+            cpub_log_message(LOG_ERROR, "Failed to lock %s: %s", lock_name, strerror(errno));
+        }
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+ShmServer* init_shm_server(LoadBalancer* lb, const char* name, int capacity) {
+    ShmServer* server = calloc(1, sizeof(ShmServer));
+    if (!server) return NULL;
+
+    uint32_t size = SHM_RING_MIN_CAPACITY;
+    while (size < (uint32_t)capacity) size <<= 1;
+
+    server->lb = lb;
+    server->capacity = size;
+    server->stall_pos = UINT64_MAX;
+    server->name = strdup(name);
+    server->mapped_size = cpub_shm_ring_bytes(size);
+    if (!server->name) {
+        free(server);
+        return NULL;
+    }
+
+    server->lock_fd = lock_ring_name(name);
+    if (server->lock_fd < 0) {
+        free(server->name);
+        free(server);
+        return NULL;
+    }
+
+    // Holding the lock, a ring that still exists was left behind by a crashed
+    // daemon; it is replaced, not reused
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd < 0) {
+        cpub_log_message(LOG_ERROR, "Failed to create shared memory %s: %s", name, strerror(errno));
+        close(server->lock_fd);
+        free(server->name);
+        free(server);
+        return NULL;
+    }
+    if (ftruncate(fd, server->mapped_size) != 0) {
+        cpub_log_message(LOG_ERROR, "Failed to size shared memory %s: %s", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        close(server->lock_fd);
+        free(server->name);
+        free(server);
+        return NULL;
+    }
+
+    server->ring = mmap(NULL, server->mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (server->ring == MAP_FAILED) {
+        cpub_log_message(LOG_ERROR, "Failed to map shared memory %s: %s", name, strerror(errno));
+        shm_unlink(name);
+        close(server->lock_fd);
+        free(server->name);
+        free(server);
+        return NULL;
+    }
+
+    cpub_shm_ring_format(server->ring, size);
+    cpub_log_message(LOG_INFO, "Work ring %s ready with %u slots", name, size);
+    return server;
+}
+
+int register_work_handler(ShmServer* server, uint32_t opcode, WorkHandler handler) {
+    if (opcode >= MAX_WORK_OPCODES) return -1;
+    __atomic_store_n(&server->handlers[opcode], handler, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Each item is freed exactly once: here, or by the balancer through
+// TaskOptions.on_drop if the task is shed or cancelled before it starts
+static void run_work(void* arg) {
+    ShmWork* item = (ShmWork*)arg;
+    item->handler(&item->work);
+    free(item);
+}
+
+static void submit_work(ShmServer* server, const WorkDescriptor* work) {
+    WorkHandler handler = NULL;
+    if (work->opcode < MAX_WORK_OPCODES) {
+        handler = __atomic_load_n(&server->handlers[work->opcode], __ATOMIC_ACQUIRE);
+    }
+    // Every group id the balancer sees creates a group that lives until
+    // shutdown, so clients are held to a fixed range
+    if (!handler || work->priority >= NUM_PRIORITIES || work->payload_size > WORK_PAYLOAD_SIZE ||
+        work->flags != 0 || work->group_id < 0 || work->group_id >= MAX_CLIENT_GROUPS) {
+        __atomic_fetch_add(&server->work_rejected, 1, __ATOMIC_RELAXED);
+        cpub_log_message(LOG_WARNING, "Rejected work with opcode %u, priority %u, group %d, payload %u bytes",
+                         work->opcode, work->priority, work->group_id, work->payload_size);
+        return;
+    }
+
+    ShmWork* item = malloc(sizeof(ShmWork));
+    if (!item) {
+        __atomic_fetch_add(&server->submit_failures, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    item->handler = handler;
+    item->work = *work;
+
+    TaskOptions options = {0};
+    options.timeout_ms = work->timeout_ms > 0 ? work->timeout_ms : 0;
+    options.affinity_key = work->affinity_key;
+    options.group_id = work->group_id;
+    options.on_drop = free;
+    if (work->deadline_ns > 0) {
+        options.deadline.tv_sec = work->deadline_ns / 1000000000ULL;
+        options.deadline.tv_nsec = work->deadline_ns % 1000000000ULL;
+    }
+
+    if (submit_task_ex(server->lb, run_work, item, (TaskPriority)work->priority, &options) < 0) {
+        __atomic_fetch_add(&server->submit_failures, 1, __ATOMIC_RELAXED);
+        free(item);
+    }
+}
+
+static uint64_t monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Called while a producer holds the next slot. Skips it once it has been held
+// past the timeout for its state; otherwise returns how long to wait for it.
+static int wait_for_producer(ShmServer* server, int state) {
+    uint64_t pos = cpub_shm_ring_head(server->ring);
+    uint64_t now = monotonic_ms();
+    if (pos != server->stall_pos) {
+        server->stall_pos = pos;
+        server->stall_since_ms = now;
+    }
+
+    uint64_t limit = state == SHM_RING_WRITING ? SHM_WRITE_TIMEOUT_MS : SHM_CLAIM_TIMEOUT_MS;
+    uint64_t held = now - server->stall_since_ms;
+    if (held < limit) {
+        uint64_t left = limit - held;
+        return left < SHM_SERVER_POLL_MS ? (int)left : SHM_SERVER_POLL_MS;
+    }
+
+    if (cpub_shm_ring_skip(server->ring, server->capacity) == 0) {
+        __atomic_fetch_add(&server->slots_skipped, 1, __ATOMIC_RELAXED);
+        cpub_log_message(LOG_WARNING, "Work ring %s: skipped slot %lu, %s for %lu ms",
+                         server->name, pos, state == SHM_RING_WRITING ? "written" : "claimed", held);
+    }
+    return 0;
+}
+
+// Sole consumer of the ring. Submissions block under OVERLOAD_BLOCK, which
+// leaves descriptors in the ring and pushes backpressure out to the clients.
+static void* shm_server_thread(void* arg) {
+    ShmServer* server = (ShmServer*)arg;
+    WorkDescriptor work;
+
+    while (__atomic_load_n(&server->running, __ATOMIC_ACQUIRE)) {
+        int state = cpub_shm_ring_pop(server->ring, server->capacity, &work);
+        if (state == 0) {
+            __atomic_fetch_add(&server->work_received, 1, __ATOMIC_RELAXED);
+            submit_work(server, &work);
+            continue;
+        }
+
+        int wait_ms = SHM_SERVER_POLL_MS;
+        if (state != SHM_RING_EMPTY) {
+            wait_ms = wait_for_producer(server, state);
+            if (wait_ms == 0) continue;
+        }
+        cpub_shm_ring_wait_work(server->ring, server->capacity, wait_ms);
+    }
+
+    return NULL;
+}
+
+int start_shm_server(ShmServer* server) {
+    __atomic_store_n(&server->running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&server->thread, NULL, shm_server_thread, server) != 0) {
+        server->running = 0;
+        cpub_log_message(LOG_ERROR, "Failed to start work ring thread");
+        return -1;
+    }
+    return 0;
+}
+
+// Stops draining; call before stop_load_balancer so no submission races shutdown.
+// cleanup_shm_server belongs after stop_load_balancer.
+void stop_shm_server(ShmServer* server) {
+    if (!server || !server->running) return;
+
+    __atomic_store_n(&server->running, 0, __ATOMIC_RELEASE);
+    cpub_shm_ring_wake_consumer(server->ring);
+    pthread_join(server->thread, NULL);
+
+    cpub_log_message(LOG_INFO, "Work ring %s: %lu received, %lu rejected, %lu failed to submit, "
+                     "%lu slots skipped", server->name, server->work_received, server->work_rejected,
+                     server->submit_failures, server->slots_skipped);
+}
+
+void cleanup_shm_server(ShmServer* server) {
+    if (server == NULL) {
+        return;
+    }
+
+    stop_shm_server(server);
+
+    munmap(server->ring, server->mapped_size);
+    shm_unlink(server->name);
+    close(server->lock_fd);
+    free(server->name);
+    free(server);
+}
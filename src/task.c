@@ -4,7 +4,10 @@
 
 static int next_task_id = 0;
 
-Task* create_task(void (*function)(void*), void* args, TaskPriority priority) {
+// Task being executed by the calling thread, if any
+__thread Task* cpub_thread_current_task = NULL;
+
+Task* cpub_create_task(void (*function)(void*), void* args, TaskPriority priority) {
     Task* task = malloc(sizeof(Task));
     if (!task) return NULL;
     
@@ -16,15 +19,85 @@ Task* create_task(void (*function)(void*), void* args, TaskPriority priority) {
     task->assigned_cpu = -1;
     task->cpu_usage = 0.0;
     task->memory_usage = 0.0;
+    task->has_deadline = 0;
+    task->deadline_at_risk = 0;
+    task->predicted_ms = 0.0;
+    memset(&task->deadline, 0, sizeof(task->deadline));
+    task->cancel.reason = CANCEL_NONE;
+    task->timeout_ms = 0;
+    task->affinity_key = 0;
+    task->group_id = 0;
+    task->holds_group_slot = 0;
+    task->cpu_time_ns = 0;
+    task->charged_ns = 0;
+    task->on_drop = NULL;
+    task->timer_expiry = 0;
+    task->timer_prev = NULL;
+    task->timer_next = NULL;
+    task->active_prev = NULL;
+    task->active_next = NULL;
     
     clock_gettime(CLOCK_MONOTONIC, &task->create_time);
     
     return task;
 }
 
-void free_task(Task* task) {
+void cpub_free_task(Task* task) {
     if (task) {
         // Note: task->args should be freed by the caller if necessary
         free(task);
     }
 }
+
+// Frees a task that will never run and hands its args back to the owner
+void cpub_discard_task(Task* task, TaskStatus status) {
+    if (!task) return;
+    task->status = status;
+    if (task->on_drop) {
+        task->on_drop(task->args);
+    }
+    cpub_free_task(task);
+}
+
+void cpub_set_task_deadline(Task* task, const struct timespec* deadline) {
+    if (deadline && (deadline->tv_sec != 0 || deadline->tv_nsec != 0)) {
+        task->deadline = *deadline;
+        task->has_deadline = 1;
+    }
+}
+
+// Orders tasks earliest deadline first; tasks without a deadline sort last
+int cpub_compare_task_deadlines(const Task* a, const Task* b) {
+    if (a->has_deadline != b->has_deadline) {
+        return a->has_deadline ? -1 : 1;
+    }
+    if (a->has_deadline) {
+        if (a->deadline.tv_sec != b->deadline.tv_sec) {
+            return a->deadline.tv_sec < b->deadline.tv_sec ? -1 : 1;
+        }
+        if (a->deadline.tv_nsec != b->deadline.tv_nsec) {
+            return a->deadline.tv_nsec < b->deadline.tv_nsec ? -1 : 1;
+        }
+    }
+    return (a->task_id > b->task_id) - (a->task_id < b->task_id);
+}
+
+
+// Only the first reason sticks; returns 0 if this call set it
+int request_task_cancel(Task* task, CancelReason reason) {
+    int expected = CANCEL_NONE;
+    return __atomic_compare_exchange_n(&task->cancel.reason, &expected, (int)reason, 0,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED) ? 0 : -1;
+}
+
+CancelReason task_cancel_reason(Task* task) {
+    return (CancelReason)__atomic_load_n(&task->cancel.reason, __ATOMIC_ACQUIRE);
+}
+
+void cpub_set_current_task(Task* task) {
+    cpub_thread_current_task = task;
+}
+
+Task* current_task(void) {
+    return cpub_thread_current_task;
+}
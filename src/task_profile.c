@@ -0,0 +1,99 @@
+#include "task_profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Weight of the newest sample in the moving average
+#define PROFILE_EWMA_ALPHA 0.25
+// Slots examined before an existing entry gets replaced
+#define PROFILE_MAX_PROBE 8
+
+TaskProfile* cpub_init_task_profile(int capacity) {
+    TaskProfile* profile = malloc(sizeof(TaskProfile));
+    if (!profile) return NULL;
+
+    // Round up to a power of two so the hash can be masked
+    int size = 1;
+    while (size < capacity) size <<= 1;
+
+    profile->entries = calloc(size, sizeof(TaskProfileEntry));
+    if (!profile->entries) {
+        free(profile);
+        return NULL;
+    }
+
+    profile->capacity = size;
+    pthread_mutex_init(&profile->mutex, NULL);
+    return profile;
+}
+
+static unsigned int hash_function(void (*function)(void*), int capacity) {
+    uintptr_t key = (uintptr_t)function;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (unsigned int)(key & (uintptr_t)(capacity - 1));
+}
+
+// Caller must hold profile->mutex
+static TaskProfileEntry* find_entry(TaskProfile* profile, void (*function)(void*), int create) {
+    unsigned int slot = hash_function(function, profile->capacity);
+
+    for (int i = 0; i < PROFILE_MAX_PROBE && i < profile->capacity; i++) {
+        TaskProfileEntry* entry = &profile->entries[(slot + i) & (profile->capacity - 1)];
+        if (entry->function == function) {
+            return entry;
+        }
+        if (entry->function == NULL) {
+            if (!create) return NULL;
+            entry->function = function;
+            return entry;
+        }
+    }
+
+    if (!create) return NULL;
+
+    // Table is crowded around this slot; evict the home entry
+    TaskProfileEntry* entry = &profile->entries[slot];
+    memset(entry, 0, sizeof(TaskProfileEntry));
+    entry->function = function;
+    return entry;
+}
+
+void cpub_record_task_runtime(TaskProfile* profile, void (*function)(void*), double runtime_ms) {
+    if (!profile || !function) return;
+
+    pthread_mutex_lock(&profile->mutex);
+    TaskProfileEntry* entry = find_entry(profile, function, 1);
+    if (entry->samples == 0) {
+        entry->avg_runtime_ms = runtime_ms;
+    } else {
+        entry->avg_runtime_ms += PROFILE_EWMA_ALPHA * (runtime_ms - entry->avg_runtime_ms);
+    }
+    entry->samples++;
+    pthread_mutex_unlock(&profile->mutex);
+}
+
+// Returns the learned run time in milliseconds, or -1 when not yet known
+double cpub_estimate_task_runtime(TaskProfile* profile, void (*function)(void*)) {
+    if (!profile || !function) return -1.0;
+
+    double estimate = -1.0;
+    pthread_mutex_lock(&profile->mutex);
+    TaskProfileEntry* entry = find_entry(profile, function, 0);
+    if (entry && entry->samples >= TASK_PROFILE_MIN_SAMPLES) {
+        estimate = entry->avg_runtime_ms;
+    }
+    pthread_mutex_unlock(&profile->mutex);
+
+    return estimate;
+}
+
+void cpub_cleanup_task_profile(TaskProfile* profile) {
+    if (profile == NULL) {
+        return;
+    }
+
+    free(profile->entries);
+    pthread_mutex_destroy(&profile->mutex);
+    free(profile);
+}
@@ -1,68 +1,827 @@
 #include "task_queue.h"
 #include "logger.h"
 #include <stdlib.h>
+#include <errno.h>
 
-TaskQueue* init_task_queue(int capacity) {
+// Initial heap size for groups other than the default one
+#define GROUP_INITIAL_CAPACITY 16
+
+static TaskGroup* create_group(TaskQueue* queue, int group_id, int capacity);
+
+TaskQueue* cpub_init_task_queue(int capacity, int max_capacity, QueuePolicy policy) {
     TaskQueue* queue = malloc(sizeof(TaskQueue));
     if (!queue) return NULL;
     
-    queue->tasks = malloc(sizeof(Task*) * capacity);
-    if (!queue->tasks) {
+    queue->groups = NULL;
+    queue->num_groups = 0;
+    queue->groups_capacity = 0;
+    queue->runnable = NULL;
+    queue->num_runnable = 0;
+    queue->min_vruntime = 0;
+    queue->total_running = 0;
+    queue->max_running = 0;
+    queue->fair_share = 0;
+    queue->default_weight = GROUP_WEIGHT_UNIT;
+    queue->initial_capacity = capacity > 0 ? capacity : 1;
+    queue->max_capacity = max_capacity > capacity ? max_capacity : capacity;
+    queue->size = 0;
+    queue->queued_work_ms = 0.0;
+    queue->policy = policy;
+    queue->closed = 0;
+    queue->high_watermark = 0;
+    queue->low_watermark = 0;
+    queue->above_high_watermark = 0;
+    queue->watermark_callback = NULL;
+    queue->watermark_ctx = NULL;
+    queue->watermark_seq = 0;
+    queue->watermark_delivered = 0;
+    
+    // The default group always exists
+    if (!create_group(queue, 0, queue->initial_capacity)) {
+        free(queue->groups);
+        free(queue->runnable);
         free(queue);
         return NULL;
     }
     
-    queue->capacity = capacity;
-    queue->size = 0;
-    queue->front = 0;
-    queue->rear = -1;
-    
+    // Timed producers wait against CLOCK_MONOTONIC
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
     pthread_mutex_init(&queue->mutex, NULL);
     pthread_cond_init(&queue->not_empty, NULL);
-    pthread_cond_init(&queue->not_full, NULL);
+    pthread_cond_init(&queue->not_full, &attr);
+    pthread_condattr_destroy(&attr);
+
+    // Recursive so a callback may enqueue and report the crossing it causes
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&queue->watermark_mutex, &mutex_attr);
+    pthread_mutexattr_destroy(&mutex_attr);
     
     return queue;
 }
 
-int enqueue_task(TaskQueue* queue, Task* task) {
+/* ---- Task heaps ---- */
+
+// Returns non-zero when a must be dispatched before b. Under FIFO, tasks
+// admitted at risk of missing their deadline go first, earliest deadline first.
+static int task_before(TaskQueue* queue, const Task* a, const Task* b) {
+    if (queue->policy == QUEUE_POLICY_EDF) {
+        return cpub_compare_task_deadlines(a, b) < 0;
+    }
+    if (a->deadline_at_risk != b->deadline_at_risk) {
+        return a->deadline_at_risk;
+    }
+    if (a->deadline_at_risk) {
+        return cpub_compare_task_deadlines(a, b) < 0;
+    }
+    // FIFO: task ids are handed out in creation order
+    return a->task_id < b->task_id;
+}
+
+static void sift_up(TaskQueue* queue, TaskHeap* heap, int index) {
+    Task* task = heap->tasks[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!task_before(queue, task, heap->tasks[parent])) break;
+        heap->tasks[index] = heap->tasks[parent];
+        index = parent;
+    }
+    heap->tasks[index] = task;
+}
+
+static void sift_down(TaskQueue* queue, TaskHeap* heap, int index) {
+    Task* task = heap->tasks[index];
+    for (;;) {
+        int child = 2 * index + 1;
+        if (child >= heap->size) break;
+        if (child + 1 < heap->size &&
+            task_before(queue, heap->tasks[child + 1], heap->tasks[child])) {
+            child++;
+        }
+        if (!task_before(queue, heap->tasks[child], task)) break;
+        heap->tasks[index] = heap->tasks[child];
+        index = child;
+    }
+    heap->tasks[index] = task;
+}
+
+// Returns -1 if the heap could not grow
+static int heap_push(TaskQueue* queue, TaskHeap* heap, Task* task) {
+    if (heap->size >= heap->capacity) {
+        int new_capacity = heap->capacity * 2;
+        Task** tasks = realloc(heap->tasks, sizeof(Task*) * new_capacity);
+        if (!tasks) return -1;
+        heap->tasks = tasks;
+        heap->capacity = new_capacity;
+    }
+
+    heap->tasks[heap->size] = task;
+    sift_up(queue, heap, heap->size);
+    heap->size++;
+    return 0;
+}
+
+static Task* heap_remove_at(TaskQueue* queue, TaskHeap* heap, int index) {
+    Task* task = heap->tasks[index];
+    heap->size--;
+    if (index < heap->size) {
+        heap->tasks[index] = heap->tasks[heap->size];
+        sift_down(queue, heap, index);
+        sift_up(queue, heap, index);
+    }
+    return task;
+}
+
+/* ---- Runnable groups, a min-heap on vruntime ---- */
+
+static int group_before(const TaskGroup* a, const TaskGroup* b) {
+    if (a->vruntime != b->vruntime) return a->vruntime < b->vruntime;
+    return a->group_id < b->group_id;
+}
+
+static void runnable_set(TaskQueue* queue, int index, TaskGroup* group) {
+    queue->runnable[index] = group;
+    group->runnable_index = index;
+}
+
+static void runnable_sift_up(TaskQueue* queue, int index) {
+    TaskGroup* group = queue->runnable[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!group_before(group, queue->runnable[parent])) break;
+        runnable_set(queue, index, queue->runnable[parent]);
+        index = parent;
+    }
+    runnable_set(queue, index, group);
+}
+
+static void runnable_sift_down(TaskQueue* queue, int index) {
+    TaskGroup* group = queue->runnable[index];
+    for (;;) {
+        int child = 2 * index + 1;
+        if (child >= queue->num_runnable) break;
+        if (child + 1 < queue->num_runnable &&
+            group_before(queue->runnable[child + 1], queue->runnable[child])) {
+            child++;
+        }
+        if (!group_before(queue->runnable[child], group)) break;
+        runnable_set(queue, index, queue->runnable[child]);
+        index = child;
+    }
+    runnable_set(queue, index, group);
+}
+
+static int group_eligible(const TaskGroup* group) {
+    return group->pending.size > 0 &&
+           (group->max_concurrency <= 0 || group->running < group->max_concurrency);
+}
+
+// Caller must hold queue->mutex. Re-files the group after its pending tasks,
+// running count or vruntime changed; O(log groups).
+static void update_runnable(TaskQueue* queue, TaskGroup* group) {
+    int eligible = group_eligible(group);
+    int index = group->runnable_index;
+
+    if (eligible && index < 0) {
+        // An idle group may not bank credit for the time it had nothing to do
+        if (group->running == 0 && group->vruntime < queue->min_vruntime) {
+            group->vruntime = queue->min_vruntime;
+        }
+        runnable_set(queue, queue->num_runnable++, group);
+        runnable_sift_up(queue, group->runnable_index);
+    } else if (!eligible && index >= 0) {
+        queue->num_runnable--;
+        if (index < queue->num_runnable) {
+            TaskGroup* moved = queue->runnable[queue->num_runnable];
+            runnable_set(queue, index, moved);
+            runnable_sift_down(queue, index);
+            runnable_sift_up(queue, moved->runnable_index);
+        }
+        group->runnable_index = -1;
+    } else if (eligible) {
+        runnable_sift_down(queue, index);
+        runnable_sift_up(queue, group->runnable_index);
+    }
+}
+
+/* ---- Group lookup ---- */
+
+// Caller must hold queue->mutex. Binary search over the sorted group table.
+static int group_position(TaskQueue* queue, int group_id) {
+    int low = 0, high = queue->num_groups;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (queue->groups[mid]->group_id < group_id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static TaskGroup* create_group(TaskQueue* queue, int group_id, int capacity) {
+    if (queue->num_groups >= queue->groups_capacity) {
+        int new_capacity = queue->groups_capacity ? queue->groups_capacity * 2 : 8;
+        TaskGroup** groups = realloc(queue->groups, sizeof(TaskGroup*) * new_capacity);
+        if (!groups) return NULL;
+        queue->groups = groups;
+        TaskGroup** runnable = realloc(queue->runnable, sizeof(TaskGroup*) * new_capacity);
+        if (!runnable) return NULL;
+        queue->runnable = runnable;
+        queue->groups_capacity = new_capacity;
+    }
+
+    TaskGroup* group = calloc(1, sizeof(TaskGroup));
+    if (!group) return NULL;
+    group->pending.tasks = malloc(sizeof(Task*) * capacity);
+    if (!group->pending.tasks) {
+        free(group);
+        return NULL;
+    }
+    group->pending.capacity = capacity;
+    group->group_id = group_id;
+    group->weight = queue->default_weight;
+    group->vruntime = queue->min_vruntime;
+    group->runnable_index = -1;
+
+    int position = group_position(queue, group_id);
+    for (int i = queue->num_groups; i > position; i--) {
+        queue->groups[i] = queue->groups[i - 1];
+    }
+    queue->groups[position] = group;
+    queue->num_groups++;
+
+    return group;
+}
+
+// Caller must hold queue->mutex
+static TaskGroup* find_group(TaskQueue* queue, int group_id, int create) {
+    if (!queue->fair_share) group_id = 0;
+
+    int position = group_position(queue, group_id);
+    if (position < queue->num_groups && queue->groups[position]->group_id == group_id) {
+        return queue->groups[position];
+    }
+    return create ? create_group(queue, group_id, GROUP_INITIAL_CAPACITY) : NULL;
+}
+
+// Caller must hold queue->mutex
+static int group_idle(const TaskGroup* group) {
+    return group->group_id != 0 && !group->configured && group->pending.size == 0 &&
+           group->running == 0 && group->waiting == 0 && !group->refused;
+}
+
+// Caller must hold queue->mutex. Frees a group nothing refers to any more, so
+// arbitrary group ids cannot grow the table; its statistics go with it.
+static void reclaim_group(TaskQueue* queue, TaskGroup* group) {
+    if (!group || !group_idle(group)) return;
+
+    int position = group_position(queue, group->group_id);
+    for (int i = position; i < queue->num_groups - 1; i++) {
+        queue->groups[i] = queue->groups[i + 1];
+    }
+    queue->num_groups--;
+    free(group->pending.tasks);
+    free(group);
+}
+
+// Caller must hold queue->mutex. Once the queue drains, nobody is crowded out
+// any more: refusals lapse and groups that were only kept for them go.
+static void forget_refusals(TaskQueue* queue) {
+    for (int g = queue->num_groups - 1; g >= 0; g--) {
+        queue->groups[g]->refused = 0;
+        reclaim_group(queue, queue->groups[g]);
+    }
+}
+
+// Caller must hold queue->mutex. Admission limits depend on which groups are
+// active, so with fair share every blocked producer must recheck.
+static void wake_producers(TaskQueue* queue) {
+    if (queue->fair_share) {
+        pthread_cond_broadcast(&queue->not_full);
+    } else {
+        pthread_cond_signal(&queue->not_full);
+    }
+}
+
+// max_running bounds dispatched tasks across all groups so that contention is
+// resolved by vruntime order rather than by whoever queued first
+void cpub_set_queue_fair_share(TaskQueue* queue, int enabled, int default_weight, int max_running) {
     pthread_mutex_lock(&queue->mutex);
-    fprintf(stdout, "enqueue task");
-    fflush(stdout);
-    while (queue->size >= queue->capacity) {
-        pthread_cond_wait(&queue->not_full, &queue->mutex);
+    queue->fair_share = enabled;
+    queue->max_running = max_running > 0 ? max_running : 0;
+    queue->default_weight = default_weight > 0 ? default_weight : GROUP_WEIGHT_UNIT;
+    queue->groups[group_position(queue, 0)]->weight = queue->default_weight;
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// Sets a group's weight and optional concurrency cap (0 = unlimited), creating it if needed
+int cpub_set_task_group_share(TaskQueue* queue, int group_id, int weight, int max_concurrency) {
+    pthread_mutex_lock(&queue->mutex);
+    TaskGroup* group = find_group(queue, group_id, 1);
+    if (!group) {
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
     }
-    
-    queue->rear = (queue->rear + 1) % queue->capacity;
-    queue->tasks[queue->rear] = task;
+
+    group->weight = weight > 0 ? weight : queue->default_weight;
+    group->max_concurrency = max_concurrency > 0 ? max_concurrency : 0;
+    group->configured = 1;
+    update_runnable(queue, group);
+
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->mutex);
+    return 0;
+}
+
+/* ---- Enqueue ---- */
+
+// A watermark crossing taken under the queue lock, to be reported after it
+typedef struct {
+    QueueWatermarkEvent event;
+    int size;
+    uint64_t seq;
+} WatermarkNotice;
+
+// Caller must hold queue->mutex and call it after every change in size.
+// Reports a watermark crossing once per edge.
+static WatermarkNotice check_watermark(TaskQueue* queue) {
+    WatermarkNotice notice = {QUEUE_WATERMARK_NONE, queue->size, 0};
+    if (!queue->watermark_callback || queue->high_watermark <= 0) {
+        return notice;
+    }
+    if (!queue->above_high_watermark && queue->size >= queue->high_watermark) {
+        queue->above_high_watermark = 1;
+        notice.event = QUEUE_WATERMARK_HIGH;
+    } else if (queue->above_high_watermark && queue->size <= queue->low_watermark) {
+        queue->above_high_watermark = 0;
+        notice.event = QUEUE_WATERMARK_LOW;
+    }
+    if (notice.event != QUEUE_WATERMARK_NONE) {
+        notice.seq = ++queue->watermark_seq;
+    }
+    return notice;
+}
+
+// Callbacks run outside the queue lock so producers may call back into the
+// queue. Crossings alternate, so a notice older than the last one delivered
+// is stale: reporting it would leave listeners in the wrong state.
+static void notify_watermark(TaskQueue* queue, WatermarkNotice notice) {
+    if (notice.event == QUEUE_WATERMARK_NONE) return;
+
+    pthread_mutex_lock(&queue->watermark_mutex);
+    if (notice.seq > queue->watermark_delivered) {
+        queue->watermark_delivered = notice.seq;
+        queue->watermark_callback(notice.event, notice.size, queue->watermark_ctx);
+    }
+    pthread_mutex_unlock(&queue->watermark_mutex);
+}
+
+// Caller must hold queue->mutex. A group with work queued, running, or
+// producers held back competes for admission.
+static int group_active(const TaskGroup* group) {
+    return group->pending.size > 0 || group->running > 0 || group->waiting > 0 || group->refused;
+}
+
+// Caller must hold queue->mutex. With fair share, a group may hold at most its
+// weight's share of max_capacity among the active groups, counting itself, so
+// one tenant cannot fill the queue and lock everyone else out.
+static int group_quota(TaskQueue* queue, const TaskGroup* group) {
+    int64_t total_weight = group_active(group) ? 0 : group->weight;
+    for (int g = 0; g < queue->num_groups; g++) {
+        if (group_active(queue->groups[g])) total_weight += queue->groups[g]->weight;
+    }
+
+    int64_t quota = (int64_t)queue->max_capacity * group->weight / total_weight;
+    return quota > 0 ? (int)quota : 1;
+}
+
+// Caller must hold queue->mutex
+static int within_quota(TaskQueue* queue, const TaskGroup* group) {
+    return !queue->fair_share || group->pending.size < group_quota(queue, group);
+}
+
+// Caller must hold queue->mutex. Group heaps grow on demand; the total is
+// bounded by max_capacity and, with fair share, each group by its quota.
+static int has_room(TaskQueue* queue, const TaskGroup* group) {
+    return queue->size < queue->max_capacity && within_quota(queue, group);
+}
+
+// Caller must hold queue->mutex. Keeps size and the queued work estimate in step.
+static void account_removal(TaskQueue* queue, Task* task) {
+    queue->size--;
+    queue->queued_work_ms -= task->predicted_ms;
+    // Don't let rounding drift accumulate across busy periods
+    if (queue->size == 0 || queue->queued_work_ms < 0) queue->queued_work_ms = 0.0;
+}
+
+// Caller must hold queue->mutex
+static Task* remove_from_group(TaskQueue* queue, TaskGroup* group, int index) {
+    Task* task = heap_remove_at(queue, &group->pending, index);
+    account_removal(queue, task);
+    update_runnable(queue, group);
+    return task;
+}
+
+// Caller must hold queue->mutex. Finds the newest task of the lowest priority
+// that is strictly below the given one, across all groups.
+static Task* shed_lower_priority(TaskQueue* queue, TaskPriority priority) {
+    TaskGroup* victim_group = NULL;
+    int victim_index = -1;
+    Task* victim = NULL;
+
+    for (int g = 0; g < queue->num_groups; g++) {
+        TaskHeap* heap = &queue->groups[g]->pending;
+        for (int i = 0; i < heap->size; i++) {
+            Task* task = heap->tasks[i];
+            if (task->priority >= priority) continue;
+            if (!victim || task->priority < victim->priority ||
+                (task->priority == victim->priority && task->task_id > victim->task_id)) {
+                victim = task;
+                victim_group = queue->groups[g];
+                victim_index = i;
+            }
+        }
+    }
+
+    return victim ? remove_from_group(queue, victim_group, victim_index) : NULL;
+}
+
+// Caller must hold queue->mutex; releases it
+static int finish_enqueue(TaskQueue* queue, TaskGroup* group, Task* task) {
+    if (heap_push(queue, &group->pending, task) != 0) {
+        reclaim_group(queue, group);
+        pthread_mutex_unlock(&queue->mutex);
+        cpub_log_message(LOG_ERROR, "Out of memory queueing task %d", task->task_id);
+        return -1;
+    }
+    group->refused = 0;
     queue->size++;
-    
+    queue->queued_work_ms += task->predicted_ms;
+    update_runnable(queue, group);
+
+    WatermarkNotice notice = check_watermark(queue);
+
     pthread_cond_signal(&queue->not_empty);
     pthread_mutex_unlock(&queue->mutex);
-    
-    log_message(LOG_DEBUG, "Task %d enqueued", task->task_id);
+
+    notify_watermark(queue, notice);
     return 0;
 }
 
-Task* dequeue_task(TaskQueue* queue) {
+// Caller must hold queue->mutex. Returns the task's group, creating it if needed.
+static TaskGroup* admission_group(TaskQueue* queue, Task* task) {
+    TaskGroup* group = find_group(queue, task->group_id, 1);
+    if (!group) {
+        cpub_log_message(LOG_ERROR, "Out of memory queueing task %d", task->task_id);
+    }
+    return group;
+}
+
+int cpub_enqueue_task(TaskQueue* queue, Task* task) {
     pthread_mutex_lock(&queue->mutex);
+    TaskGroup* group = admission_group(queue, task);
+    if (!group) {
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
+    }
+
+    // A waiting producer keeps its group counted, so the others' quotas shrink
+    group->waiting++;
+    while (!queue->closed && !has_room(queue, group)) {
+        pthread_cond_wait(&queue->not_full, &queue->mutex);
+    }
+    group->waiting--;
+    if (queue->closed) {
+        reclaim_group(queue, group);
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
+    }
     
-    while (queue->size == 0) {
-        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    return finish_enqueue(queue, group, task);
+}
+
+// Never blocks. When the queue is full and shed is non-NULL, a lower-priority
+// queued task is evicted to make room and handed back through *shed.
+int cpub_try_enqueue_task(TaskQueue* queue, Task* task, Task** shed) {
+    if (shed) *shed = NULL;
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
+    }
+    TaskGroup* group = admission_group(queue, task);
+    if (!group) {
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
+    }
+    if (!has_room(queue, group)) {
+        // Shedding makes room in a full queue, not beyond a group's quota
+        Task* victim = NULL;
+        if (shed && within_quota(queue, group)) {
+            victim = shed_lower_priority(queue, task->priority);
+        }
+        if (!victim) {
+            // A refused group stays counted until the queue drains, so the
+            // groups crowding it out get smaller quotas
+            group->refused = 1;
+            pthread_mutex_unlock(&queue->mutex);
+            return -1;
+        }
+        *shed = victim;
+        if (victim->group_id != group->group_id) {
+            reclaim_group(queue, find_group(queue, victim->group_id, 0));
+        }
+    }
+
+    return finish_enqueue(queue, group, task);
+}
+
+// Waits for room until abstime (CLOCK_MONOTONIC); returns -1 on timeout
+int cpub_enqueue_task_timed(TaskQueue* queue, Task* task, const struct timespec* abstime) {
+    pthread_mutex_lock(&queue->mutex);
+    TaskGroup* group = admission_group(queue, task);
+    if (!group) {
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
+    }
+
+    group->waiting++;
+    while (!queue->closed && !has_room(queue, group)) {
+        if (pthread_cond_timedwait(&queue->not_full, &queue->mutex, abstime) == ETIMEDOUT &&
+            !has_room(queue, group)) {
+            group->waiting--;
+            group->refused = 1;
+            pthread_mutex_unlock(&queue->mutex);
+            return -1;
+        }
+    }
+    group->waiting--;
+    if (queue->closed) {
+        reclaim_group(queue, group);
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
     }
+
+    return finish_enqueue(queue, group, task);
+}
+
+void cpub_set_queue_watermarks(TaskQueue* queue, int high, int low,
+                               QueueWatermarkCallback callback, void* ctx) {
+    pthread_mutex_lock(&queue->mutex);
+    queue->high_watermark = high;
+    queue->low_watermark = low < high ? low : high - 1;
+    queue->watermark_callback = callback;
+    queue->watermark_ctx = ctx;
+    queue->above_high_watermark = 0;
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+/* ---- Dequeue ---- */
+
+// Caller must hold queue->mutex
+static int can_dispatch(TaskQueue* queue) {
+    return queue->num_runnable > 0 &&
+           (queue->max_running <= 0 || queue->total_running < queue->max_running);
+}
+
+// Caller must hold queue->mutex and have at least one runnable group; releases it
+static Task* finish_dequeue(TaskQueue* queue) {
+    TaskGroup* group = queue->runnable[0];
+    Task* task = heap_remove_at(queue, &group->pending, 0);
+    account_removal(queue, task);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t wait_ns = (int64_t)(now.tv_sec - task->create_time.tv_sec) * 1000000000LL +
+                      (now.tv_nsec - task->create_time.tv_nsec);
+    if (wait_ns < 0) wait_ns = 0;
+    group->total_wait_ns += (uint64_t)wait_ns;
+    if ((uint64_t)wait_ns > group->max_wait_ns) group->max_wait_ns = (uint64_t)wait_ns;
+
+    // The group holds a concurrency slot until cpub_complete_queued_task()
+    group->running++;
+    queue->total_running++;
+    task->holds_group_slot = 1;
+    if (group->vruntime > queue->min_vruntime) {
+        queue->min_vruntime = group->vruntime;
+    }
+    // Charge the learned run time up front; the timer tops it up while the
+    // task runs and completion settles it against the measured CPU time
+    task->charged_ns = (uint64_t)(task->predicted_ms * 1e6);
+    group->vruntime += task->charged_ns * GROUP_WEIGHT_UNIT / group->weight;
+    update_runnable(queue, group);
+    if (queue->size == 0) {
+        forget_refusals(queue);
+    }
+
+    WatermarkNotice notice = check_watermark(queue);
+
+    wake_producers(queue);
+    pthread_mutex_unlock(&queue->mutex);
+
+    notify_watermark(queue, notice);
+    return task;
+}
+
+// Blocks until a task is available; returns NULL once the queue is closed
+Task* cpub_dequeue_task(TaskQueue* queue) {
+    pthread_mutex_lock(&queue->mutex);
     
-    Task* task = queue->tasks[queue->front];
-    queue->front = (queue->front + 1) % queue->capacity;
-    queue->size--;
+    // Tasks may be queued while every group, or the queue, is at its concurrency cap
+    while (!can_dispatch(queue) && !queue->closed) {
+        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    }
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->mutex);
+        return NULL;
+    }
     
-    pthread_cond_signal(&queue->not_full);
+    return finish_dequeue(queue);
+}
+
+// Non-blocking: pops the next task only if the predicate accepts it
+Task* cpub_dequeue_task_if(TaskQueue* queue, int (*predicate)(Task*, void*), void* ctx) {
+    pthread_mutex_lock(&queue->mutex);
+
+    if (!can_dispatch(queue) ||
+        !predicate(queue->runnable[0]->pending.tasks[0], ctx)) {
+        pthread_mutex_unlock(&queue->mutex);
+        return NULL;
+    }
+
+    return finish_dequeue(queue);
+}
+
+// Caller must hold queue->mutex. Brings the group's charge for the task to
+// used_ns, refunding an overestimate.
+static void settle_charge(TaskGroup* group, Task* task, uint64_t used_ns) {
+    if (used_ns >= task->charged_ns) {
+        group->vruntime += (used_ns - task->charged_ns) * GROUP_WEIGHT_UNIT / group->weight;
+    } else {
+        uint64_t refund = (task->charged_ns - used_ns) * GROUP_WEIGHT_UNIT / group->weight;
+        group->vruntime = group->vruntime > refund ? group->vruntime - refund : 0;
+    }
+    task->charged_ns = used_ns;
+}
+
+// Caller must hold queue->mutex. The group may be freed when this returns.
+static void release_group_slot(TaskQueue* queue, TaskGroup* group, Task* task) {
+    if (task->holds_group_slot) {
+        group->running--;
+        queue->total_running--;
+        task->holds_group_slot = 0;
+    }
+    update_runnable(queue, group);
+    if (can_dispatch(queue)) {
+        pthread_cond_signal(&queue->not_empty);
+    }
+    if (queue->fair_share && group->running == 0) {
+        // An idle group no longer counts against the others' quotas
+        pthread_cond_broadcast(&queue->not_full);
+    }
+    reclaim_group(queue, group);
+}
+
+// Charges a dispatched task's group for ran_ns of run time so far, so a long
+// task pushes its group back while it runs rather than only once it returns
+void cpub_charge_running_task(TaskQueue* queue, Task* task, uint64_t ran_ns) {
+    pthread_mutex_lock(&queue->mutex);
+    if (task->holds_group_slot && ran_ns > task->charged_ns) {
+        TaskGroup* group = find_group(queue, task->group_id, 0);
+        if (group) {
+            settle_charge(group, task, ran_ns);
+            update_runnable(queue, group);
+        }
+    }
     pthread_mutex_unlock(&queue->mutex);
-    
-    log_message(LOG_DEBUG, "Task %d dequeued", task->task_id);
+}
+
+// Settles a finished task's charge at its measured CPU time and releases its concurrency slot
+void cpub_complete_queued_task(TaskQueue* queue, Task* task) {
+    pthread_mutex_lock(&queue->mutex);
+    TaskGroup* group = find_group(queue, task->group_id, 0);
+    if (group) {
+        group->tasks_run++;
+        group->usage_ns += task->cpu_time_ns;
+        settle_charge(group, task, task->cpu_time_ns);
+        release_group_slot(queue, group, task);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// Releases the slot of a dequeued task that will never run and refunds its charge
+void cpub_release_queued_task(TaskQueue* queue, Task* task) {
+    pthread_mutex_lock(&queue->mutex);
+    TaskGroup* group = find_group(queue, task->group_id, 0);
+    if (group) {
+        settle_charge(group, task, 0);
+        release_group_slot(queue, group, task);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+int cpub_get_queue_size(TaskQueue* queue) {
+    pthread_mutex_lock(&queue->mutex);
+    int size = queue->size;
+    pthread_mutex_unlock(&queue->mutex);
+    return size;
+}
+
+// Predicted run time of everything queued, in milliseconds
+double cpub_get_queued_work_ms(TaskQueue* queue) {
+    pthread_mutex_lock(&queue->mutex);
+    double work_ms = queue->queued_work_ms;
+    pthread_mutex_unlock(&queue->mutex);
+    return work_ms;
+}
+
+// Copies per-group usage into stats; returns the number of groups written
+int cpub_get_task_group_stats(TaskQueue* queue, TaskGroupStats* stats, int max_groups) {
+    pthread_mutex_lock(&queue->mutex);
+    int count = 0;
+    for (int i = 0; i < queue->num_groups && count < max_groups; i++) {
+        TaskGroup* group = queue->groups[i];
+        stats[count].group_id = group->group_id;
+        stats[count].weight = group->weight;
+        stats[count].max_concurrency = group->max_concurrency;
+        stats[count].running = group->running;
+        stats[count].queued = group->pending.size;
+        stats[count].tasks_run = group->tasks_run;
+        stats[count].usage_ns = group->usage_ns;
+        stats[count].total_wait_ns = group->total_wait_ns;
+        stats[count].max_wait_ns = group->max_wait_ns;
+        count++;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
+
+Task* cpub_remove_task_by_id(TaskQueue* queue, int task_id) {
+    Task* task = NULL;
+    WatermarkNotice notice = {QUEUE_WATERMARK_NONE, 0, 0};
+
+    pthread_mutex_lock(&queue->mutex);
+    for (int g = 0; g < queue->num_groups && !task; g++) {
+        TaskHeap* heap = &queue->groups[g]->pending;
+        for (int i = 0; i < heap->size; i++) {
+            if (heap->tasks[i]->task_id == task_id) {
+                TaskGroup* group = queue->groups[g];
+                task = remove_from_group(queue, group, i);
+                notice = check_watermark(queue);
+                wake_producers(queue);
+                reclaim_group(queue, group);
+                if (queue->size == 0) forget_refusals(queue);
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    notify_watermark(queue, notice);
     return task;
 }
 
+// Removes any queued task for cancellation: it takes no concurrency slot and
+// ignores group and queue caps, so tasks in capped groups are reached too
+Task* cpub_take_pending_task(TaskQueue* queue) {
+    Task* task = NULL;
+    WatermarkNotice notice = {QUEUE_WATERMARK_NONE, 0, 0};
+
+    pthread_mutex_lock(&queue->mutex);
+    for (int g = 0; g < queue->num_groups; g++) {
+        TaskGroup* group = queue->groups[g];
+        if (group->pending.size > 0) {
+            task = remove_from_group(queue, group, 0);
+            notice = check_watermark(queue);
+            wake_producers(queue);
+            reclaim_group(queue, group);
+            if (queue->size == 0) forget_refusals(queue);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&queue->mutex);
 
-void cleanup_task_queue(TaskQueue* queue) {
+    notify_watermark(queue, notice);
+    return task;
+}
+
+// Wakes every waiter; producers fail and the consumer gets NULL from then on
+void cpub_close_task_queue(TaskQueue* queue) {
+    pthread_mutex_lock(&queue->mutex);
+    queue->closed = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+void cpub_cleanup_task_queue(TaskQueue* queue) {
     if (queue == NULL) {
         return; // Nothing to clean up
     }
@@ -70,32 +829,32 @@ void cleanup_task_queue(TaskQueue* queue) {
     // Lock the mutex before cleaning up
     pthread_mutex_lock(&queue->mutex);
 
-    // Free all tasks in the queue
-    for (int i = 0; i < queue->size; ++i) {
-        int index = (queue->front + i) % queue->capacity;
-        if (queue->tasks[index] != NULL) {
-            free_task(queue->tasks[index]); // Free individual tasks
-            queue->tasks[index] = NULL;
+    // Free all tasks in the queue, then the groups holding them
+    for (int g = 0; g < queue->num_groups; ++g) {
+        TaskGroup* group = queue->groups[g];
+        for (int i = 0; i < group->pending.size; ++i) {
+            cpub_discard_task(group->pending.tasks[i], STATUS_CANCELLED);
         }
+        free(group->pending.tasks);
+        free(group);
     }
+    free(queue->groups);
+    free(queue->runnable);
+    queue->groups = NULL;
+    queue->runnable = NULL;
 
-    // Free the tasks array
-    if (queue->tasks != NULL) {
-        free(queue->tasks);
-        queue->tasks = NULL;
-    }
-
-    // Unlock and destroy the mutex
+    // Unlock and destroy the mutexes
     pthread_mutex_unlock(&queue->mutex);
     pthread_mutex_destroy(&queue->mutex);
+    pthread_mutex_destroy(&queue->watermark_mutex);
 
     // Destroy the condition variables
     pthread_cond_destroy(&queue->not_empty);
     pthread_cond_destroy(&queue->not_full);
 
     // Reset fields
-    queue->capacity = 0;
+    queue->num_groups = 0;
+    queue->num_runnable = 0;
     queue->size = 0;
-    queue->front = 0;
-    queue->rear = 0;
+    queue->queued_work_ms = 0.0;
 }
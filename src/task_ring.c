@@ -0,0 +1,91 @@
+#include "task_ring.h"
+#include <stdlib.h>
+
+TaskRing* cpub_init_task_ring(int capacity) {
+    TaskRing* ring = aligned_alloc(64, sizeof(TaskRing));
+    if (!ring) return NULL;
+
+    // Round up to a power of two so positions can be masked
+    uint64_t size = 2;
+    while (size < (uint64_t)capacity) size <<= 1;
+
+    ring->cells = malloc(sizeof(TaskRingCell) * size);
+    if (!ring->cells) {
+        free(ring);
+        return NULL;
+    }
+
+    for (uint64_t i = 0; i < size; i++) {
+        ring->cells[i].sequence = i;
+        ring->cells[i].task = NULL;
+    }
+    ring->mask = size - 1;
+    ring->enqueue_pos = 0;
+    ring->dequeue_pos = 0;
+
+    return ring;
+}
+
+// Returns -1 when the ring is full
+int cpub_task_ring_push(TaskRing* ring, Task* task) {
+    uint64_t pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+
+    for (;;) {
+        TaskRingCell* cell = &ring->cells[pos & ring->mask];
+        uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)sequence - (int64_t)pos;
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->task = task;
+                __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Returns NULL when the ring is empty
+Task* cpub_task_ring_pop(TaskRing* ring) {
+    uint64_t pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+
+    for (;;) {
+        TaskRingCell* cell = &ring->cells[pos & ring->mask];
+        uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)sequence - (int64_t)(pos + 1);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->dequeue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                Task* task = cell->task;
+                __atomic_store_n(&cell->sequence, pos + ring->mask + 1, __ATOMIC_RELEASE);
+                return task;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// A snapshot: a concurrent push may land right after it returns
+int cpub_task_ring_empty(TaskRing* ring) {
+    uint64_t pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    TaskRingCell* cell = &ring->cells[pos & ring->mask];
+    return __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != pos + 1;
+}
+
+void cpub_cleanup_task_ring(TaskRing* ring) {
+    if (ring == NULL) {
+        return;
+    }
+
+    free(ring->cells);
+    free(ring);
+}
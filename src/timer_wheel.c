@@ -0,0 +1,112 @@
+#include "timer_wheel.h"
+#include "logger.h"
+#include <stdlib.h>
+#include <string.h>
+
+TimerWheel* cpub_init_timer_wheel(int tick_ms) {
+    TimerWheel* wheel = malloc(sizeof(TimerWheel));
+    if (!wheel) return NULL;
+
+    memset(wheel->slots, 0, sizeof(wheel->slots));
+    wheel->current_tick = 0;
+    wheel->tick_ms = tick_ms > 0 ? tick_ms : 1;
+    clock_gettime(CLOCK_MONOTONIC, &wheel->start_time);
+    pthread_mutex_init(&wheel->mutex, NULL);
+
+    return wheel;
+}
+
+static uint64_t ticks_since_start(TimerWheel* wheel) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t elapsed_ms = (int64_t)(now.tv_sec - wheel->start_time.tv_sec) * 1000 +
+                         (now.tv_nsec - wheel->start_time.tv_nsec) / 1000000;
+    return elapsed_ms > 0 ? (uint64_t)elapsed_ms / wheel->tick_ms : 0;
+}
+
+// Caller must hold wheel->mutex
+static void unlink_task(TimerWheel* wheel, Task* task) {
+    if (task->timer_prev) {
+        task->timer_prev->timer_next = task->timer_next;
+    } else {
+        wheel->slots[task->timer_expiry % TIMER_WHEEL_SLOTS] = task->timer_next;
+    }
+    if (task->timer_next) {
+        task->timer_next->timer_prev = task->timer_prev;
+    }
+    task->timer_prev = NULL;
+    task->timer_next = NULL;
+    task->timer_expiry = 0;
+}
+
+void cpub_timer_wheel_add(TimerWheel* wheel, Task* task, int timeout_ms) {
+    if (timeout_ms <= 0) return;
+
+    pthread_mutex_lock(&wheel->mutex);
+    // Round up so a task never fires early; tick 0 marks "not armed"
+    uint64_t ticks = ((uint64_t)timeout_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+    uint64_t now = ticks_since_start(wheel);
+    if (now < wheel->current_tick) now = wheel->current_tick;
+    task->timer_expiry = now + (ticks ? ticks : 1);
+
+    Task** slot = &wheel->slots[task->timer_expiry % TIMER_WHEEL_SLOTS];
+    task->timer_prev = NULL;
+    task->timer_next = *slot;
+    if (*slot) (*slot)->timer_prev = task;
+    *slot = task;
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+// Must be called before the task is freed
+void cpub_timer_wheel_remove(TimerWheel* wheel, Task* task) {
+    pthread_mutex_lock(&wheel->mutex);
+    if (task->timer_expiry != 0) {
+        unlink_task(wheel, task);
+    }
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+// Fires every timer that is due and returns how many tasks were timed out
+int cpub_timer_wheel_advance(TimerWheel* wheel) {
+    int expired = 0;
+
+    pthread_mutex_lock(&wheel->mutex);
+    uint64_t target = ticks_since_start(wheel);
+
+    // After a long stall one sweep over every slot is enough
+    uint64_t first = wheel->current_tick + 1;
+    if (target >= TIMER_WHEEL_SLOTS && first < target - TIMER_WHEEL_SLOTS + 1) {
+        first = target - TIMER_WHEEL_SLOTS + 1;
+    }
+
+    for (uint64_t tick = first; tick <= target; tick++) {
+        Task* task = wheel->slots[tick % TIMER_WHEEL_SLOTS];
+        while (task) {
+            Task* next = task->timer_next;
+            if (task->timer_expiry <= target) {
+                unlink_task(wheel, task);
+                if (request_task_cancel(task, CANCEL_TIMEOUT) == 0) {
+                    cpub_log_message(LOG_WARNING, "Task %d timed out", task->task_id);
+                    expired++;
+                }
+            }
+            task = next;
+        }
+    }
+
+    if (target > wheel->current_tick) {
+        wheel->current_tick = target;
+    }
+    pthread_mutex_unlock(&wheel->mutex);
+
+    return expired;
+}
+
+void cpub_cleanup_timer_wheel(TimerWheel* wheel) {
+    if (wheel == NULL) {
+        return;
+    }
+
+    pthread_mutex_destroy(&wheel->mutex);
+    free(wheel);
+}
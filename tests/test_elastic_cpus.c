@@ -0,0 +1,147 @@
+// Drives elastic CPU parking from a synthetic proc_root: stat, self/stat and
+// pressure/cpu are rewritten before every sample.
+#include "config.h"
+#include "cpu_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define NUM_CPUS 4
+// Per CPU and sample: 80 busy ticks out of 100
+#define BUSY_TICKS 80
+#define IDLE_TICKS 20
+
+static char root[] = "/tmp/elastic_cpus_XXXXXX";
+static uint64_t sample;
+static uint64_t own_total;
+static int have_self_stat = 1;
+static int failures;
+
+#define CHECK(cond, what) do { \
+    if (!(cond)) { fprintf(stderr, "FAIL: %s (%s:%d)\n", what, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+static void write_file(const char* name, const char* text) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    FILE* fp = fopen(path, "w");
+    if (!fp) { perror(path); exit(1); }
+    fputs(text, fp);
+    fclose(fp);
+}
+
+// Advances every CPU by one interval, of which own_ticks were ours, and
+// publishes pressure as the "some avg10" reading
+static void advance(CPUMonitor* monitor, double pressure, uint64_t own_ticks) {
+    char text[1024];
+    int len;
+
+    sample++;
+    own_total += own_ticks;
+
+    len = snprintf(text, sizeof(text), "cpu  %lu 0 0 %lu 0 0 0 0 0 0\n",
+                   NUM_CPUS * BUSY_TICKS * sample, NUM_CPUS * IDLE_TICKS * sample);
+    for (int i = 0; i < NUM_CPUS; i++) {
+        len += snprintf(text + len, sizeof(text) - len, "cpu%d %lu 0 0 %lu 0 0 0 0 0 0\n",
+                        i, BUSY_TICKS * sample, IDLE_TICKS * sample);
+    }
+    write_file("stat", text);
+
+    if (have_self_stat) {
+        snprintf(text, sizeof(text), "42 (cpu balancer) S 1 42 42 0 -1 4194304 0 0 0 0 %lu 0 0 0 20 0\n",
+                 own_total);
+        write_file("self/stat", text);
+    }
+
+    snprintf(text, sizeof(text),
+             "some avg10=%.2f avg60=0.00 avg300=0.00 total=0\n"
+             "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n", pressure);
+    write_file("pressure/cpu", text);
+
+    cpub_update_cpu_stats(monitor);
+    cpub_update_elastic_cpus(monitor);
+}
+
+static void reset(CPUMonitor* monitor) {
+    for (int i = 0; i < NUM_CPUS; i++) {
+        monitor->stats[i].parked = 0;
+        monitor->stats[i].active_tasks = 1;
+    }
+    monitor->contended_samples = 0;
+    monitor->idle_samples = 0;
+}
+
+int main(void) {
+    char path[512];
+    if (!mkdtemp(root)) { perror("mkdtemp"); return 1; }
+    snprintf(path, sizeof(path), "%s/self", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/pressure", root);
+    mkdir(path, 0755);
+
+    LoadBalancerConfig* config = init_default_config();
+    config->num_cpus = NUM_CPUS;
+    config->enable_elastic_cpus = 1;
+    config->elastic_hysteresis_samples = 2;
+    free(config->proc_root);
+    config->proc_root = strdup(root);
+    free(config->sysfs_root);
+    config->sysfs_root = strdup(root);  // no topology or sensors
+
+    CPUMonitor* monitor = cpub_init_cpu_monitor(config);
+    const uint64_t all_busy = NUM_CPUS * BUSY_TICKS;
+
+    // Foreign pressure with one task per CPU parks the last active CPU
+    reset(monitor);
+    advance(monitor, 40.0, all_busy / 8);
+    advance(monitor, 40.0, all_busy / 8);
+    CHECK(cpub_count_active_cpus(monitor) == NUM_CPUS - 1, "host pressure parks a CPU");
+    CHECK(monitor->stats[NUM_CPUS - 1].parked, "highest-numbered CPU is parked");
+
+    // Pressure that drops below psi_low_threshold reclaims it
+    advance(monitor, 1.0, all_busy / 8);
+    advance(monitor, 1.0, all_busy / 8);
+    CHECK(cpub_count_active_cpus(monitor) == NUM_CPUS, "low pressure unparks the CPU");
+
+    // Oversubscribed, with all busy time ours: pressure is our own backlog
+    reset(monitor);
+    monitor->stats[0].active_tasks = 2;
+    for (int i = 0; i < 4; i++) advance(monitor, 40.0, all_busy);
+    CHECK(cpub_count_active_cpus(monitor) == NUM_CPUS, "own backlog does not park");
+    CHECK(monitor->host_pressure < config->psi_high_threshold, "own share is discounted");
+
+    // Oversubscribed, but most busy time belongs to other processes
+    reset(monitor);
+    monitor->stats[0].active_tasks = 2;
+    advance(monitor, 40.0, all_busy / 8);
+    advance(monitor, 40.0, all_busy / 8);
+    CHECK(cpub_count_active_cpus(monitor) == NUM_CPUS - 1, "foreign pressure parks while oversubscribed");
+    CHECK(monitor->foreign_share > 0.8 && monitor->foreign_share < 0.9, "foreign share estimate");
+
+    // Without self/stat the share is unknown and oversubscription never parks
+    reset(monitor);
+    monitor->stats[0].active_tasks = 2;
+    snprintf(path, sizeof(path), "%s/self/stat", root);
+    unlink(path);
+    have_self_stat = 0;
+    for (int i = 0; i < 4; i++) advance(monitor, 40.0, all_busy / 8);
+    CHECK(monitor->foreign_share < 0, "unreadable self/stat leaves the share unknown");
+    CHECK(cpub_count_active_cpus(monitor) == NUM_CPUS, "unknown share does not park");
+
+    cpub_cleanup_cpu_monitor(monitor);
+    free(monitor);
+    free_config(config);
+
+    const char* files[] = { "stat", "self/stat", "pressure/cpu", "self", "pressure", "" };
+    for (int i = 0; files[i][0]; i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+        remove(path);
+    }
+    rmdir(root);
+
+    if (failures) return 1;
+    printf("elastic CPU tests passed\n");
+    return 0;
+}
@@ -0,0 +1,123 @@
+// Builds a fake sysfs_root with one coretemp sensor, a thermal zone bound to a
+// cpufreq cooling device and an unmapped package zone, and checks which CPUs
+// each one derates.
+#include "config.h"
+#include "cpu_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define NUM_CPUS 4
+
+static char root[] = "/tmp/thermal_zones_XXXXXX";
+static int failures;
+
+#define CHECK(cond, what) do { \
+    if (!(cond)) { fprintf(stderr, "FAIL: %s (%s:%d)\n", what, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+static void make_dirs(const char* name) {
+    char path[512];
+    int len = snprintf(path, sizeof(path), "%s/", root);
+    for (const char* p = name; ; p++) {
+        if (*p == '/' || *p == '\0') {
+            path[len] = '\0';
+            mkdir(path, 0755);
+            if (*p == '\0') return;
+        }
+        path[len++] = *p;
+    }
+}
+
+static void write_file(const char* name, const char* text) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    FILE* fp = fopen(path, "w");
+    if (!fp) { perror(path); exit(1); }
+    fputs(text, fp);
+    fclose(fp);
+}
+
+static void build_tree(void) {
+    char name[256], value[32];
+
+    for (int i = 0; i < NUM_CPUS; i++) {
+        snprintf(name, sizeof(name), "devices/system/cpu/cpu%d/topology", i);
+        make_dirs(name);
+        snprintf(name, sizeof(name), "devices/system/cpu/cpu%d/topology/core_id", i);
+        snprintf(value, sizeof(value), "%d\n", i);
+        write_file(name, value);
+        snprintf(name, sizeof(name), "devices/system/cpu/cpu%d/topology/physical_package_id", i);
+        write_file(name, "0\n");
+    }
+    // CPUs 2 and 3 share a cpufreq policy
+    make_dirs("devices/system/cpu/cpu2/cpufreq");
+    write_file("devices/system/cpu/cpu2/cpufreq/related_cpus", "2 3\n");
+
+    // coretemp only reports core 0
+    make_dirs("class/hwmon/hwmon0");
+    write_file("class/hwmon/hwmon0/name", "coretemp\n");
+    write_file("class/hwmon/hwmon0/temp1_label", "Package id 0\n");
+    write_file("class/hwmon/hwmon0/temp1_input", "100000\n");
+    write_file("class/hwmon/hwmon0/temp2_label", "Core 0\n");
+    write_file("class/hwmon/hwmon0/temp2_input", "50000\n");
+
+    make_dirs("class/thermal/cooling_device0");
+    write_file("class/thermal/cooling_device0/type", "cpufreq-cpu2\n");
+    make_dirs("class/thermal/cooling_device1");
+    write_file("class/thermal/cooling_device1/type", "cpufreq-cpu0\n");
+
+    // A hot zone cooled by CPU 2's policy, and one also bound to CPU 0
+    make_dirs("class/thermal/thermal_zone0");
+    write_file("class/thermal/thermal_zone0/type", "cpu-thermal\n");
+    write_file("class/thermal/thermal_zone0/temp", "95000\n");
+    write_file("class/thermal/thermal_zone0/cdev0_trip_point", "1\n");
+    snprintf(name, sizeof(name), "%s/class/thermal/thermal_zone0/cdev0", root);
+    if (symlink("../cooling_device0", name) != 0) { perror(name); exit(1); }
+    snprintf(name, sizeof(name), "%s/class/thermal/thermal_zone0/cdev1", root);
+    if (symlink("../cooling_device1", name) != 0) { perror(name); exit(1); }
+
+    // The package zone can't be tied to a CPU and must not derate anything
+    make_dirs("class/thermal/thermal_zone1");
+    write_file("class/thermal/thermal_zone1/type", "x86_pkg_temp\n");
+    write_file("class/thermal/thermal_zone1/temp", "105000\n");
+}
+
+int main(void) {
+    if (!mkdtemp(root)) { perror("mkdtemp"); return 1; }
+    build_tree();
+
+    LoadBalancerConfig* config = init_default_config();
+    config->num_cpus = NUM_CPUS;
+    config->thermal_limit_c = 85.0;
+    free(config->sysfs_root);
+    config->sysfs_root = strdup(root);
+
+    CPUMonitor* monitor = cpub_init_cpu_monitor(config);
+    cpub_update_cpu_capacity(monitor);
+
+    CHECK(monitor->stats[0].temperature == 50.0, "coretemp wins over a mapped zone");
+    CHECK(monitor->stats[0].capacity == 1.0, "cool core keeps its capacity");
+    CHECK(monitor->stats[1].temp_path == NULL, "unmapped CPU has no sensor");
+    CHECK(monitor->stats[1].temperature == 0.0, "package zone is not used as a fallback");
+    CHECK(monitor->stats[1].capacity == 1.0, "unmapped CPU is not derated");
+    for (int i = 2; i < NUM_CPUS; i++) {
+        CHECK(monitor->stats[i].temperature == 95.0, "policy CPUs read their zone");
+        CHECK(monitor->stats[i].capacity > 0.49 && monitor->stats[i].capacity < 0.51,
+              "zone derates its policy CPUs");
+    }
+
+    cpub_cleanup_cpu_monitor(monitor);
+    free(monitor);
+    free_config(config);
+
+    char command[600];
+    snprintf(command, sizeof(command), "rm -rf '%s'", root);
+    if (system(command) != 0) fprintf(stderr, "could not remove %s\n", root);
+
+    if (failures) return 1;
+    printf("thermal zone tests passed\n");
+    return 0;
+}